@@ -0,0 +1,103 @@
+#include <string.h>
+
+#include <err.h>
+#include <sys/mman.h>
+
+#include "arena.h"
+
+// Chunks are a multiple of the 2 MiB huge page size.
+#define ARENA_CHUNK_SIZE (4 << 20)
+// Keep blocks aligned for the widest field in an element.
+#define ARENA_ALIGN (16)
+#define ALIGN_UP(x) (((x) + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1))
+
+void arena_init(struct Arena* a, size_t unit, uint8_t hugePages) {
+    memset(a, 0, sizeof(struct Arena));
+    a->unit = unit;
+    a->chunkSize = ARENA_CHUNK_SIZE;
+    a->hugePages = hugePages;
+}
+
+// Moves the bump pointer into the next chunk, mapping one if there are none left over from a reset.
+static void next_chunk(struct Arena* a) {
+    // What is left at the end of this chunk is never handed out.
+    if (a->next)
+        __atomic_fetch_add(&a->bytesCarved, (size_t)(a->end - a->next), __ATOMIC_RELAXED);
+    if (a->current && a->current->next) {
+        a->current = a->current->next;
+    } else {
+        struct ArenaChunk* chunk = mmap(NULL, a->chunkSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (chunk == MAP_FAILED)
+            err(1, "mmap(): Cannot grow arena");
+#ifdef MADV_HUGEPAGE
+        if (a->hugePages && madvise(chunk, a->chunkSize, MADV_HUGEPAGE) < 0)
+            warn("madvise(): Huge pages unavailable for arena");
+#endif // MADV_HUGEPAGE
+        chunk->next = NULL;
+        chunk->size = a->chunkSize;
+        if (a->current)
+            a->current->next = chunk;
+        else
+            a->chunks = chunk;
+        a->current = chunk;
+    }
+    a->next = (uint8_t*)a->current + ALIGN_UP(sizeof(struct ArenaChunk));
+    a->end = (uint8_t*)a->current + a->current->size;
+    __atomic_fetch_add(&a->bytesCarved, ALIGN_UP(sizeof(struct ArenaChunk)), __ATOMIC_RELAXED);
+}
+
+void* arena_alloc(struct Arena* a, size_t n) {
+    if (n == 0)
+        return NULL;
+    size_t bytes = ALIGN_UP(n * a->unit);
+    // Atomic, as the tree reads the counts without holding the lock around its arena calls.
+    __atomic_fetch_add(&a->bytesInUse, bytes, __ATOMIC_RELAXED);
+
+    // Reuse a block of the same length
+    void* block = a->freeLists[n];
+    if (block) {
+        a->freeLists[n] = *(void**)block;
+        return block;
+    }
+
+    if (a->next == NULL || a->next + bytes > a->end)
+        next_chunk(a);
+    block = a->next;
+    a->next += bytes;
+    __atomic_fetch_add(&a->bytesCarved, bytes, __ATOMIC_RELAXED);
+    return block;
+}
+
+void arena_free(struct Arena* a, void* block, size_t n) {
+    if (block == NULL || n == 0)
+        return;
+    __atomic_fetch_sub(&a->bytesInUse, ALIGN_UP(n * a->unit), __ATOMIC_RELAXED);
+    *(void**)block = a->freeLists[n];
+    a->freeLists[n] = block;
+}
+
+void arena_reset(struct Arena* a) {
+    a->current = NULL;
+    a->next = NULL;
+    a->end = NULL;
+    __atomic_store_n(&a->bytesCarved, 0, __ATOMIC_RELAXED);
+    if (a->chunks) {
+        // Start again from the first chunk; next_chunk() moves on to the others.
+        a->current = a->chunks;
+        a->next = (uint8_t*)a->chunks + ALIGN_UP(sizeof(struct ArenaChunk));
+        a->end = (uint8_t*)a->chunks + a->chunks->size;
+        __atomic_store_n(&a->bytesCarved, ALIGN_UP(sizeof(struct ArenaChunk)), __ATOMIC_RELAXED);
+    }
+    memset(a->freeLists, 0, sizeof(a->freeLists));
+    __atomic_store_n(&a->bytesInUse, 0, __ATOMIC_RELAXED);
+}
+
+void arena_destroy(struct Arena* a) {
+    struct ArenaChunk* chunk = a->chunks;
+    while (chunk) {
+        struct ArenaChunk* next = chunk->next;
+        munmap(chunk, chunk->size);
+        chunk = next;
+    }
+    memset(a, 0, sizeof(struct Arena));
+}
@@ -0,0 +1,51 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// ===========================================================================
+// Arena allocator
+// Blocks of whole elements are carved out of large chunks with a bump pointer.
+// Freed blocks are kept on a free list per block length for the next block of that length,
+// and the whole arena can be emptied at once without visiting any block.
+// The arena itself is not thread-safe: its callers in tree.c serialize access with the tree's arenaLock.
+// ===========================================================================
+// Longest block, in elements.
+#define ARENA_MAX_BLOCK (256)
+
+struct ArenaChunk {
+    struct ArenaChunk* next;
+    size_t size;
+};
+
+struct Arena {
+    size_t unit;      // Size of one element
+    size_t chunkSize; // Bytes mapped at a time
+    uint8_t hugePages;
+
+    // Chunks, oldest first. Chunks after current are empty and kept for reuse after a reset.
+    struct ArenaChunk* chunks;
+    struct ArenaChunk* current;
+    uint8_t* next;
+    uint8_t* end;
+
+    void* freeLists[ARENA_MAX_BLOCK + 1];
+    size_t bytesInUse; // Handed out and not freed
+    // Taken from the chunks since the last reset, freed blocks included, as they are only reused for blocks of their
+    // own length. No chunk is mapped until this grows into it, so it bounds what the arena holds.
+    size_t bytesCarved;
+};
+
+// hugePages asks the kernel to back chunks with transparent huge pages.
+void arena_init(struct Arena* a, size_t unit, uint8_t hugePages);
+// Returns a block of n elements, or NULL if n is zero.
+void* arena_alloc(struct Arena* a, size_t n);
+// Returns a block of n elements for reuse.
+void arena_free(struct Arena* a, void* block, size_t n);
+// Frees every block at once. The chunks stay mapped for reuse.
+void arena_reset(struct Arena* a);
+// Unmaps every chunk.
+void arena_destroy(struct Arena* a);
+
+#endif // ARENA_H
@@ -0,0 +1,302 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "batch.h"
+#include "board.h"
+#include "playout.h"
+#include "pool.h"
+#include "search.h"
+#include "tree.h"
+
+// Iterations without a new node before a node budget gives up: the tree has stopped growing.
+#define BATCH_STALL_ITERS (10000)
+
+// When to stop searching a position. Any limit that is not zero can end the search.
+struct Budget {
+    uint64_t playouts; // Games simulated from the root
+    uint64_t nodes;    // Positions in the tree
+    double seconds;
+    struct PlayoutLimits limits;
+};
+
+// What every task shares
+struct Batch {
+    struct Budget budget;
+    // Per worker, by pool_worker_index(). A tree is set up on its worker's first position and reused.
+    struct Tree* trees;
+    uint8_t* treeReady;
+    struct Worker* workers;
+
+    pthread_mutex_t lock;
+    pthread_cond_t done; // A position has been written out
+    uint32_t inFlight;   // Positions submitted and not yet written out
+    uint64_t positions, playouts;
+};
+
+// One line of input
+struct BatchTask {
+    struct Batch* b;
+    uint64_t line;
+    char* text;
+};
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// Writes str as a JSON string, quoted.
+static void json_string(FILE* f, const char* str, size_t n) {
+    fputc('"', f);
+    for (size_t i = 0; i < n && str[i]; i++) {
+        char c = str[i];
+        if (c == '"' || c == '\\')
+            fprintf(f, "\\%c", c);
+        else if ((unsigned char)c < 0x20)
+            fprintf(f, "\\u%04x", c);
+        else
+            fputc(c, f);
+    }
+    fputc('"', f);
+}
+
+// Writes the EPD id operation among ops, e.g. `id "WAC.001";`, if there is one.
+static void epd_id(FILE* f, const char* ops) {
+    for (const char* c = ops; (c = strstr(c, "id")) != NULL; c += 2) {
+        if (c != ops && c[-1] != ' ' && c[-1] != ';')
+            continue;
+        const char* open = c + 2;
+        while (*open == ' ')
+            open++;
+        if (*open != '"')
+            continue;
+        const char* close = strchr(open + 1, '"');
+        if (close == NULL)
+            return;
+        fprintf(f, ",\"id\":");
+        json_string(f, open + 1, close - open - 1);
+        return;
+    }
+}
+
+// Searches s on this worker's tree to the budget, and writes the most visited move and the root's statistics.
+static void search_position(struct Batch* b, int w, const struct State* s, FILE* f) {
+    struct Tree* t = &b->trees[w];
+    if (!b->treeReady[w]) {
+        tree_init(t, s);
+        b->treeReady[w] = 1;
+    } else {
+        tree_reset(t, s);
+    }
+    struct Children* root = tree_expand(t, t->rootNode, &t->root);
+    if (root->n == 0) {
+        fprintf(f, ",\"result\":\"%s\"", is_in_check(&t->root) ? "checkmate" : "stalemate");
+        return;
+    }
+    if (t->root.halfmoveClock >= FIFTY_MOVE_PLIES) {
+        fprintf(f, ",\"result\":\"draw\"");
+        return;
+    }
+
+    const struct Budget* budget = &b->budget;
+    struct Worker* worker = &b->workers[w];
+    memset(&worker->stats, 0, sizeof(struct SearchStats));
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    uint64_t lastNodes = 0, stalled = 0;
+    for (;;) {
+        mcts_iter(t, &budget->limits, worker);
+        if (budget->playouts && t->rootNode->visits >= budget->playouts)
+            break;
+        if (budget->nodes) {
+            if (t->nodes >= budget->nodes)
+                break;
+            if (t->nodes != lastNodes) {
+                lastNodes = t->nodes;
+                stalled = 0;
+            } else if (++stalled == BATCH_STALL_ITERS) {
+                break;
+            }
+        }
+        if (budget->seconds > 0 && seconds_since(&start) >= budget->seconds)
+            break;
+    }
+    double seconds = seconds_since(&start);
+
+    char algebra[ALGEBRA_LEN];
+    struct Move m;
+    // The move UCI would play
+    int best = most_visited(root);
+    if (best < 0)
+        best = 0;
+    unpack_move(&t->root, root->move[best], &m);
+    move_to_algebra(&m, algebra);
+    fprintf(f, ",\"best\":\"%s\",\"visits\":%u,\"playouts\":%lu,\"nodes\":%lu,\"ms\":%.1f,\"moves\":[",
+            algebra, t->rootNode->visits, worker->stats.playouts, t->nodes, seconds * 1e3);
+    for (uint8_t i = 0; i < root->n; i++) {
+        struct MoveStats ms;
+        root_move_stats(t, i, &ms);
+        unpack_move(&t->root, root->move[i], &m);
+        move_to_algebra(&m, algebra);
+        fprintf(f, "%s{\"move\":\"%s\",\"visits\":%u,\"wins\":%u,\"losses\":%u}", i ? "," : "",
+                algebra, ms.visits, ms.wins, ms.losses);
+    }
+    fprintf(f, "]");
+
+    pthread_mutex_lock(&b->lock);
+    b->playouts += worker->stats.playouts;
+    pthread_mutex_unlock(&b->lock);
+}
+
+// Pool task: analyses one line of input and writes its result.
+static void analyse(void* arg) {
+    struct BatchTask* task = (struct BatchTask*)arg;
+    struct Batch* b = task->b;
+
+    // The whole object is formatted first, so results from different workers do not interleave.
+    char* out;
+    size_t outLen;
+    FILE* f = open_memstream(&out, &outLen);
+    if (f == NULL)
+        err(1, "open_memstream(): Cannot format result");
+    fprintf(f, "{\"line\":%lu", task->line);
+    struct State s;
+    const char* ops = state_from_fen(&s, task->text);
+    if (ops == NULL) {
+        fprintf(f, ",\"error\":\"Not a legal position\",\"input\":");
+        json_string(f, task->text, strlen(task->text));
+    } else {
+        char fen[FEN_LEN];
+        state_to_fen(&s, fen);
+        fprintf(f, ",\"fen\":\"%s\"", fen);
+        epd_id(f, ops);
+        search_position(b, pool_worker_index(), &s, f);
+    }
+    fprintf(f, "}\n");
+    fclose(f);
+
+    flockfile(stdout);
+    fputs(out, stdout);
+    fflush(stdout);
+    funlockfile(stdout);
+    free(out);
+    free(task->text);
+    free(task);
+
+    pthread_mutex_lock(&b->lock);
+    b->inFlight--;
+    b->positions++;
+    pthread_cond_signal(&b->done);
+    pthread_mutex_unlock(&b->lock);
+}
+
+static int usage(void) {
+    fprintf(stderr, "Usage: boris batch [-j threads] [-p playouts] [-n nodes] [-t ms] [-l plies] [-s swing] [file]\n"
+            "Reads one FEN or EPD per line, from standard input if no file is given.\n");
+    return 1;
+}
+
+int batch_main(int argc, char** argv) {
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    struct Batch b = {.budget = {0, 0, 0, {0, 0}}};
+    int arg = 0;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        long value = atol(argv[arg + 1]);
+        if (strcmp(argv[arg], "-j") == 0)
+            nthreads = value;
+        else if (strcmp(argv[arg], "-p") == 0 && value > 0)
+            b.budget.playouts = value;
+        else if (strcmp(argv[arg], "-n") == 0 && value > 0)
+            b.budget.nodes = value;
+        else if (strcmp(argv[arg], "-t") == 0 && value > 0)
+            b.budget.seconds = value / 1e3;
+        else if (strcmp(argv[arg], "-l") == 0 && value >= 0 && value <= PLAYOUT_MAX_PLIES)
+            b.budget.limits.maxPlies = value;
+        else if (strcmp(argv[arg], "-s") == 0 && value >= 0 && value <= INT16_MAX)
+            b.budget.limits.swing = value;
+        else
+            return usage();
+    }
+    if (arg < argc - 1)
+        return usage();
+    if (nthreads < 1)
+        nthreads = 1;
+    if (!b.budget.playouts && !b.budget.nodes && b.budget.seconds == 0)
+        b.budget.playouts = BATCH_DEFAULT_PLAYOUTS;
+
+    FILE* in = stdin;
+    if (arg < argc) {
+        in = fopen(argv[arg], "r");
+        if (in == NULL)
+            err(1, "fopen(): Cannot open %s", argv[arg]);
+    }
+
+    b.trees = malloc(nthreads * sizeof(struct Tree));
+    b.treeReady = calloc(nthreads, sizeof(uint8_t));
+    b.workers = malloc(nthreads * sizeof(struct Worker));
+    if (b.trees == NULL || b.treeReady == NULL || b.workers == NULL)
+        err(1, "malloc(): Cannot allocate workers");
+    for (int t = 0; t < nthreads; t++)
+        b.workers[t].rng = playout_seed(time(NULL) + (t * 7));
+    pthread_mutex_init(&b.lock, NULL);
+    pthread_cond_init(&b.done, NULL);
+    struct Pool pool;
+    pool_init(&pool, nthreads);
+    struct PoolGroup group = {0};
+
+    // Keep a couple of positions queued per worker, reading more as they finish.
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    char* text = NULL;
+    size_t textSize = 0;
+    ssize_t len;
+    uint64_t line = 0;
+    while ((len = getline(&text, &textSize, in)) >= 0) {
+        line++;
+        while (len > 0 && (text[len - 1] == '\n' || text[len - 1] == '\r'))
+            text[--len] = 0;
+        if (len == 0 || text[0] == '#')
+            continue;
+
+        pthread_mutex_lock(&b.lock);
+        while (b.inFlight >= 2 * (uint32_t)nthreads)
+            pthread_cond_wait(&b.done, &b.lock);
+        b.inFlight++;
+        pthread_mutex_unlock(&b.lock);
+
+        struct BatchTask* task = malloc(sizeof(struct BatchTask));
+        if (task == NULL)
+            err(1, "malloc(): Cannot allocate task");
+        task->b = &b;
+        task->line = line;
+        task->text = strdup(text);
+        void* args[1] = {task};
+        pool_submit(&pool, analyse, args, 1, &group);
+    }
+    pool_wait(&pool, &group);
+    double seconds = seconds_since(&start);
+    fprintf(stderr, "%lu positions in %.2f s: %.0f positions/hour, %.0f playouts/sec\n", b.positions, seconds,
+            b.positions / seconds * 3600, b.playouts / seconds);
+
+    free(text);
+    if (in != stdin)
+        fclose(in);
+    pool_destroy(&pool);
+    for (int t = 0; t < nthreads; t++)
+        if (b.treeReady[t])
+            tree_destroy(&b.trees[t]);
+    free(b.trees);
+    free(b.treeReady);
+    free(b.workers);
+    pthread_mutex_destroy(&b.lock);
+    pthread_cond_destroy(&b.done);
+    return 0;
+}
@@ -0,0 +1,17 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+// ===========================================================================
+// Batch analysis
+// Positions are streamed in as FEN or EPD, one per line. Each is searched to a fixed budget
+// by one worker on a tree of its own, so every core is busy with a different position.
+// Results are streamed out as JSON, one object per line, in the order they finish.
+// ===========================================================================
+// Playouts per position when no budget is given.
+#define BATCH_DEFAULT_PLAYOUTS (10000)
+
+// `boris batch [-j threads] [-p playouts] [-n nodes] [-t ms] [-l plies] [-s swing] [file]`,
+// given the arguments after "batch". Reads standard input if no file is given.
+int batch_main(int argc, char** argv);
+
+#endif // BATCH_H
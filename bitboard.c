@@ -0,0 +1,423 @@
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __BMI2__
+#include <immintrin.h>
+#endif // __BMI2__
+
+#include "bitboard.h"
+
+// PROMOTION: Promotable roles
+static const uint8_t promotableRoles[4] = {BISHOP, KNIGHT, ROOK, QUEEN};
+// CASTLING: Relative Rook positions: 0-1, Direction of King movement: 2-3 (Queenside first)
+static const int8_t castlingSquares[4] = {4*LEFT, 3*RIGHT, LEFT, RIGHT};
+
+// ===========================================================================
+// Attack tables
+// ===========================================================================
+static uint64_t knightAttacks[64], kingAttacks[64];
+// Squares attacked by a pawn of each colour (0: White, 1: Black) standing on a square.
+static uint64_t pawnAttacks[2][64];
+
+// Slider attacks are looked up by the occupancy of the squares that can block the slider.
+// With BMI2 the index is PEXT of the occupancy, otherwise it is a magic multiplication.
+struct SliderTable {
+    uint64_t mask; // Squares that can block the slider, excluding the edge of the board.
+    uint64_t magic;
+    uint8_t shift;
+    uint64_t* attacks;
+};
+static struct SliderTable rookTable[64], bishopTable[64];
+// Squares strictly between two squares on a shared rank, file or diagonal; empty otherwise.
+static uint64_t betweenBB[64][64];
+static uint64_t rookAttackData[102400], bishopAttackData[5248];
+
+// Directions as (rank, file) steps. ROOK: 0-3, BISHOP: 4-7
+static const int8_t slideSteps[8][2] = {{0, -1}, {0, 1}, {1, 0}, {-1, 0}, {1, -1}, {1, 1}, {-1, -1}, {-1, 1}};
+
+static inline uint8_t pop_lsb(uint64_t* b) {
+    uint8_t sq = __builtin_ctzll(*b);
+    *b &= *b - 1;
+    return sq;
+}
+
+static inline uint64_t slider_index(const struct SliderTable* t, uint64_t occ) {
+#ifdef __BMI2__
+    return _pext_u64(occ, t->mask);
+#else
+    return ((occ & t->mask) * t->magic) >> t->shift;
+#endif // __BMI2__
+}
+
+// Attacks of a slider, found by stepping along each ray. Only used to fill the tables.
+// If mask is set, the last square of each ray is left out.
+static uint64_t slide_attacks(uint8_t sq, uint64_t occ, uint8_t firstDirn, uint8_t mask) {
+    uint64_t attacks = 0;
+    for (uint8_t d = firstDirn; d < firstDirn + 4; d++) {
+        int8_t r = sq >> 3;
+        int8_t f = sq & 0x07;
+        for (;;) {
+            r += slideSteps[d][0];
+            f += slideSteps[d][1];
+            if (r < 0 || r > 7 || f < 0 || f > 7)
+                break;
+            if (mask) {
+                int8_t nr = r + slideSteps[d][0];
+                int8_t nf = f + slideSteps[d][1];
+                if (nr < 0 || nr > 7 || nf < 0 || nf > 7)
+                    break;
+            }
+            attacks |= BB_BIT(BB_SQ(r, f));
+            if (occ & BB_BIT(BB_SQ(r, f)))
+                break;
+        }
+    }
+    return attacks;
+}
+
+#ifndef __BMI2__
+static uint64_t rand64(void) {
+    static uint64_t x = 0x9E3779B97F4A7C15ULL; // Fixed seed: the tables come out the same every run.
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+// Tries sparse random numbers until one maps every occupancy to a non-conflicting index.
+static void find_magic(struct SliderTable* t, const uint64_t* occs, const uint64_t* refs, uint32_t n) {
+    static uint32_t used[4096];
+    static uint32_t attempt = 0;
+    for (;;) {
+        t->magic = rand64() & rand64() & rand64();
+        if (__builtin_popcountll((t->mask * t->magic) >> 56) < 6)
+            continue;
+        attempt++;
+        uint32_t i;
+        for (i = 0; i < n; i++) {
+            uint64_t idx = slider_index(t, occs[i]);
+            if (used[idx] != attempt) {
+                used[idx] = attempt;
+                t->attacks[idx] = refs[i];
+            } else if (t->attacks[idx] != refs[i]) {
+                break;
+            }
+        }
+        if (i == n)
+            return;
+    }
+}
+#endif // __BMI2__
+
+static void init_sliders(struct SliderTable* table, uint64_t* data, uint8_t firstDirn) {
+    static uint64_t occs[4096], refs[4096];
+    for (uint8_t sq = 0; sq < 64; sq++) {
+        struct SliderTable* t = &table[sq];
+        t->mask = slide_attacks(sq, 0, firstDirn, 1);
+        t->shift = 64 - __builtin_popcountll(t->mask);
+        t->attacks = data;
+
+        // Enumerate every subset of the mask (Carry-Rippler)
+        uint32_t n = 0;
+        uint64_t sub = 0;
+        do {
+            occs[n] = sub;
+            refs[n] = slide_attacks(sq, sub, firstDirn, 0);
+            n++;
+            sub = (sub - t->mask) & t->mask;
+        } while (sub);
+
+#ifdef __BMI2__
+        for (uint32_t i = 0; i < n; i++)
+            t->attacks[slider_index(t, occs[i])] = refs[i];
+#else
+        find_magic(t, occs, refs, n);
+#endif // __BMI2__
+        data += n;
+    }
+}
+
+void bb_init(void) {
+    static const int8_t knightSteps[8][2] = {{2, -1}, {2, 1}, {1, 2}, {-1, 2}, {-2, -1}, {-2, 1}, {-1, -2}, {1, -2}};
+    for (uint8_t sq = 0; sq < 64; sq++) {
+        int8_t r = sq >> 3;
+        int8_t f = sq & 0x07;
+        knightAttacks[sq] = 0;
+        kingAttacks[sq] = 0;
+        for (uint8_t d = 0; d < 8; d++) {
+            int8_t nr = r + knightSteps[d][0];
+            int8_t nf = f + knightSteps[d][1];
+            if (nr >= 0 && nr <= 7 && nf >= 0 && nf <= 7)
+                knightAttacks[sq] |= BB_BIT(BB_SQ(nr, nf));
+            nr = r + slideSteps[d][0];
+            nf = f + slideSteps[d][1];
+            if (nr >= 0 && nr <= 7 && nf >= 0 && nf <= 7)
+                kingAttacks[sq] |= BB_BIT(BB_SQ(nr, nf));
+        }
+        pawnAttacks[0][sq] = 0;
+        pawnAttacks[1][sq] = 0;
+        for (int8_t df = -1; df <= 1; df += 2) {
+            if (f + df < 0 || f + df > 7)
+                continue;
+            if (r < 7)
+                pawnAttacks[0][sq] |= BB_BIT(BB_SQ(r + 1, f + df));
+            if (r > 0)
+                pawnAttacks[1][sq] |= BB_BIT(BB_SQ(r - 1, f + df));
+        }
+    }
+    init_sliders(rookTable, rookAttackData, 0);
+    init_sliders(bishopTable, bishopAttackData, 4);
+
+    for (uint8_t a = 0; a < 64; a++)
+    for (uint8_t b = 0; b < 64; b++) {
+        betweenBB[a][b] = 0;
+        if (bb_rook_attacks(a, 0) & BB_BIT(b))
+            betweenBB[a][b] = bb_rook_attacks(a, BB_BIT(b)) & bb_rook_attacks(b, BB_BIT(a));
+        else if (bb_bishop_attacks(a, 0) & BB_BIT(b))
+            betweenBB[a][b] = bb_bishop_attacks(a, BB_BIT(b)) & bb_bishop_attacks(b, BB_BIT(a));
+    }
+}
+
+uint64_t bb_rook_attacks(uint8_t sq, uint64_t occ) {
+    return rookTable[sq].attacks[slider_index(&rookTable[sq], occ)];
+}
+
+uint64_t bb_bishop_attacks(uint8_t sq, uint64_t occ) {
+    return bishopTable[sq].attacks[slider_index(&bishopTable[sq], occ)];
+}
+
+uint64_t bb_attackers(const struct Bitboards* bb, uint8_t sq, uint64_t occ, uint8_t colour) {
+    uint64_t diagonal = bb->roles[BISHOP] | bb->roles[QUEEN];
+    uint64_t straight = bb->roles[ROOK] | bb->roles[QUEEN];
+    return ((pawnAttacks[!colour][sq] & bb->roles[PAWN])
+            | (knightAttacks[sq] & bb->roles[KNIGHT])
+            | (kingAttacks[sq] & bb->roles[KING])
+            | (bb_bishop_attacks(sq, occ) & diagonal)
+            | (bb_rook_attacks(sq, occ) & straight)) & bb->colours[colour] & occ;
+}
+
+void bb_from_state(const struct State* s, struct Bitboards* bb) {
+    memset(bb, 0, sizeof(struct Bitboards));
+    for (uint8_t sq = 0; sq < 64; sq++) {
+        uint8_t piece = s->board[FROM_SQ64(sq)];
+        if (IS_VACANT(piece))
+            continue;
+        bb->roles[ROLE(piece)] |= BB_BIT(sq);
+        bb->colours[IS_BLACK(piece) ? 1 : 0] |= BB_BIT(sq);
+    }
+    bb->occupied = bb->colours[0] | bb->colours[1];
+}
+
+// ===========================================================================
+// Move generation
+// ===========================================================================
+// Everything the generator needs to know about the position, worked out once per state.
+struct GenContext {
+    const struct State* s;
+    struct Move* out;
+    uint8_t n;
+    const struct Bitboards* bb; // The state's own
+    uint8_t us;     // Colour of the player to move
+    uint8_t kingSq; // 64 if the player to move has no King
+    uint64_t checkers;
+    // Squares a move other than the King's must land on: everywhere, or onto or in front of the checking piece.
+    uint64_t evasions;
+    // Pieces pinned against the King, and for each one the squares along the pin it may still move to.
+    uint64_t pinned;
+    uint64_t pinRay[64];
+};
+
+static void add_move(struct GenContext* g, uint8_t orig, uint8_t dest, uint64_t captured, uint8_t promoRole) {
+    struct Move* m = &g->out[g->n++];
+    m->orig = FROM_SQ64(orig);
+    m->dest = FROM_SQ64(dest);
+    m->role = ROLE(g->s->board[m->orig]);
+    m->valid = 1;
+    m->pieceCaptured = captured != 0;
+    m->promoRole = promoRole;
+}
+
+// Adds the move if it does not leave the King of the player to move in check, by looking at the occupancy after it.
+// Only needed where the pin and check masks fall short: King moves, castling and en passant.
+// captured is the bit of the piece taken (if any), which differs from dest for en passant.
+static void add_if_legal(struct GenContext* g, uint8_t orig, uint8_t dest, uint64_t captured) {
+    if (g->kingSq < 64) {
+        uint64_t occ = (g->bb->occupied & ~BB_BIT(orig) & ~captured) | BB_BIT(dest);
+        uint8_t kingSq = (g->kingSq == orig) ? dest : g->kingSq;
+        if (bb_attackers(g->bb, kingSq, occ, !g->us) & ~captured)
+            return;
+    }
+    add_move(g, orig, dest, captured, 0);
+}
+
+// Squares the piece on orig may move to without exposing or ignoring a check.
+static inline uint64_t allowed_squares(const struct GenContext* g, uint8_t orig) {
+    return (g->pinned & BB_BIT(orig)) ? g->evasions & g->pinRay[orig] : g->evasions;
+}
+
+static void add_pawn_move(struct GenContext* g, uint8_t orig, uint8_t dest, uint64_t captured) {
+    if ((dest >> 3) == (g->us ? 0 : 7)) {
+        // There should be a move for each role.
+        for (uint8_t i = 0; i < 4; i++)
+            add_move(g, orig, dest, captured, promotableRoles[i]);
+    } else {
+        add_move(g, orig, dest, captured, 0);
+    }
+}
+
+static void add_piece_moves(struct GenContext* g, uint8_t orig, uint64_t targets) {
+    targets &= ~g->bb->colours[g->us] & allowed_squares(g, orig);
+    while (targets) {
+        uint8_t dest = pop_lsb(&targets);
+        add_move(g, orig, dest, BB_BIT(dest) & g->bb->colours[!g->us], 0);
+    }
+}
+
+static void add_pawn_moves(struct GenContext* g) {
+    const struct Bitboards* bb = g->bb;
+    int8_t forward = g->us ? -8 : 8;
+    uint8_t startRank = g->us ? 6 : 1;
+
+    // The pawn that made a two-step on the last move can be taken en passant.
+    uint8_t epPawn = 64;
+    const struct Move* last = &g->s->lastMove;
+    if (last->valid && ROLE(g->s->board[last->dest]) == PAWN && IS_PAWN_TWO_STEP(g->s->board[last->dest]))
+        epPawn = TO_SQ64(last->dest);
+
+    uint64_t pawns = bb->roles[PAWN] & bb->colours[g->us];
+    while (pawns) {
+        uint8_t orig = pop_lsb(&pawns);
+        uint64_t allowed = allowed_squares(g, orig);
+        uint8_t dest = orig + forward;
+        if (!(bb->occupied & BB_BIT(dest))) {
+            if (allowed & BB_BIT(dest))
+                add_pawn_move(g, orig, dest, 0);
+            // Two-step
+            if ((orig >> 3) == startRank && !(bb->occupied & BB_BIT(dest + forward)) && (allowed & BB_BIT(dest + forward)))
+                add_pawn_move(g, orig, dest + forward, 0);
+        }
+
+        uint64_t captures = pawnAttacks[g->us][orig] & bb->colours[!g->us] & allowed;
+        while (captures) {
+            dest = pop_lsb(&captures);
+            add_pawn_move(g, orig, dest, BB_BIT(dest));
+        }
+
+        // En passant takes two pieces off a rank at once, so it is checked in full.
+        if (epPawn < 64 && (pawnAttacks[g->us][orig] & BB_BIT(epPawn + forward)))
+            add_if_legal(g, orig, epPawn + forward, BB_BIT(epPawn));
+    }
+}
+
+static void add_king_moves(struct GenContext* g) {
+    uint64_t targets = kingAttacks[g->kingSq] & ~g->bb->colours[g->us];
+    // The King must not stay on a line it is being checked along, so it is taken off the board.
+    uint64_t occ = g->bb->occupied & ~BB_BIT(g->kingSq);
+    while (targets) {
+        uint8_t dest = pop_lsb(&targets);
+        if (!bb_attackers(g->bb, dest, occ, !g->us))
+            add_move(g, g->kingSq, dest, BB_BIT(dest) & g->bb->colours[!g->us], 0);
+    }
+}
+
+static void add_castles(struct GenContext* g) {
+    const struct State* s = g->s;
+    uint8_t orig = FROM_SQ64(g->kingSq);
+    if (IS_PIECE_MOVED(s->board[orig]))
+        return;
+
+    for (uint8_t side = 0; side < 2; side++) { // 0: Queenside, 1: Kingside
+        uint8_t corner = orig + castlingSquares[side];
+        if (!is_on_board(corner))
+            continue;
+        uint8_t cornerPiece = s->board[corner];
+        if (ROLE(cornerPiece) != ROOK || IS_PIECE_MOVED(cornerPiece) || !IS_BLACK(cornerPiece) != !g->us)
+            continue;
+
+        // There are no pieces in between.
+        uint8_t obstruction = 0;
+        for (uint8_t checkPosn = orig + castlingSquares[side + 2]; checkPosn != corner; checkPosn += castlingSquares[side + 2]) {
+            if (!IS_VACANT(s->board[checkPosn])) {
+                obstruction = 1;
+                break;
+            }
+        }
+        if (obstruction)
+            continue;
+
+        // The King does not pass through a square that is attacked.
+        uint8_t pass = TO_SQ64(orig + castlingSquares[side + 2]);
+        uint64_t occ = (g->bb->occupied & ~BB_BIT(g->kingSq)) | BB_BIT(pass);
+        if (bb_attackers(g->bb, pass, occ, !g->us))
+            continue;
+
+        add_if_legal(g, g->kingSq, TO_SQ64(orig + 2 * castlingSquares[side + 2]), 0);
+    }
+}
+
+// Finds the pieces checking the King, and those pinned to it by sliders behind them.
+static void find_checks_and_pins(struct GenContext* g) {
+    const struct Bitboards* bb = g->bb;
+    uint64_t own = bb->colours[g->us];
+    uint64_t them = bb->colours[!g->us];
+    g->checkers = bb_attackers(bb, g->kingSq, bb->occupied, !g->us);
+    g->evasions = ~0ULL;
+    if (g->checkers) {
+        uint8_t checker = __builtin_ctzll(g->checkers);
+        g->evasions = betweenBB[g->kingSq][checker] | g->checkers;
+    }
+
+    // Sliders that would attack the King on an empty board
+    g->pinned = 0;
+    uint64_t snipers = ((bb_rook_attacks(g->kingSq, 0) & (bb->roles[ROOK] | bb->roles[QUEEN]))
+            | (bb_bishop_attacks(g->kingSq, 0) & (bb->roles[BISHOP] | bb->roles[QUEEN]))) & them;
+    while (snipers) {
+        uint8_t sniper = pop_lsb(&snipers);
+        uint64_t blockers = betweenBB[g->kingSq][sniper] & bb->occupied;
+        if (blockers && !(blockers & (blockers - 1)) && (blockers & own)) {
+            g->pinned |= blockers;
+            g->pinRay[__builtin_ctzll(blockers)] = betweenBB[g->kingSq][sniper] | BB_BIT(sniper);
+        }
+    }
+}
+
+// Only legal moves are generated: checks and pins are found first, and every move is made to respect them.
+uint8_t bb_generate_moves(const struct State* s, struct Move* out) {
+    struct GenContext g = {.s = s, .out = out, .n = 0, .bb = &s->bb, .us = BLACK_TO_MOVE(s) ? 1 : 0};
+    uint64_t own = g.bb->colours[g.us];
+    uint64_t king = g.bb->roles[KING] & own;
+    g.kingSq = king ? __builtin_ctzll(king) : 64;
+
+    g.checkers = 0;
+    g.evasions = ~0ULL;
+    g.pinned = 0;
+    if (g.kingSq < 64) {
+        find_checks_and_pins(&g);
+        add_king_moves(&g);
+        if (!g.checkers)
+            add_castles(&g);
+        // In double check, only the King can move.
+        if (g.checkers & (g.checkers - 1))
+            return g.n;
+    }
+
+    add_pawn_moves(&g);
+
+    uint64_t pieces = g.bb->roles[KNIGHT] & own;
+    while (pieces) {
+        uint8_t orig = pop_lsb(&pieces);
+        add_piece_moves(&g, orig, knightAttacks[orig]);
+    }
+    pieces = (g.bb->roles[BISHOP] | g.bb->roles[QUEEN]) & own;
+    while (pieces) {
+        uint8_t orig = pop_lsb(&pieces);
+        add_piece_moves(&g, orig, bb_bishop_attacks(orig, g.bb->occupied));
+    }
+    pieces = (g.bb->roles[ROOK] | g.bb->roles[QUEEN]) & own;
+    while (pieces) {
+        uint8_t orig = pop_lsb(&pieces);
+        add_piece_moves(&g, orig, bb_rook_attacks(orig, g.bb->occupied));
+    }
+
+    return g.n;
+}
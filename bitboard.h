@@ -0,0 +1,48 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include <stdint.h>
+
+#include "board.h"
+
+// ===========================================================================
+// Bitboard representation
+// An alternative to scanning the 0x88 board, selected with `make BITBOARD=1`.
+// Each state carries its own struct Bitboards, kept up to date as moves are made and unmade.
+// Squares are numbered as by TO_SQ64().
+// ===========================================================================
+#define BB_SQ(rank, file) (((rank) << 3) | (file))
+#define BB_BIT(sq) (1ULL << (sq))
+
+// Updates bb for the square sq changing from the piece before to after, either of which may be vacant.
+static inline void bb_replace(struct Bitboards* bb, uint8_t sq, uint8_t before, uint8_t after) {
+    uint64_t bit = BB_BIT(sq);
+    if (!IS_VACANT(before)) {
+        bb->roles[ROLE(before)] ^= bit;
+        bb->colours[IS_BLACK(before) ? 1 : 0] ^= bit;
+        bb->occupied ^= bit;
+    }
+    if (!IS_VACANT(after)) {
+        bb->roles[ROLE(after)] ^= bit;
+        bb->colours[IS_BLACK(after) ? 1 : 0] ^= bit;
+        bb->occupied ^= bit;
+    }
+}
+
+// Builds the slider attack tables. Must be called once before any other bb_ function.
+void bb_init(void);
+
+// Builds the bitboards of a 0x88 board from scratch. See refresh_state().
+void bb_from_state(const struct State* s, struct Bitboards* bb);
+
+// Squares attacked by a slider on sq, given the occupied squares.
+uint64_t bb_rook_attacks(uint8_t sq, uint64_t occ);
+uint64_t bb_bishop_attacks(uint8_t sq, uint64_t occ);
+
+// Pieces of the given colour (0: White, 1: Black) attacking sq, given the occupied squares.
+uint64_t bb_attackers(const struct Bitboards* bb, uint8_t sq, uint64_t occ, uint8_t colour);
+
+// Same contract as generate_moves().
+uint8_t bb_generate_moves(const struct State* s, struct Move* out);
+
+#endif // BITBOARD_H
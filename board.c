@@ -4,13 +4,11 @@
 #include <string.h>
 
 #include <err.h>
-#include <fcntl.h>
-#include <unistd.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <time.h>
 
 #include "board.h"
+#ifdef BITBOARD
+#include "bitboard.h"
+#endif // BITBOARD
 
 // Enumeration of roles
 static const char roleSyms[7] = {' ', 'p', 'R', 'N', 'B', 'Q', 'K'};
@@ -21,14 +19,16 @@ static const char roleSyms[7] = {' ', 'p', 'R', 'N', 'B', 'Q', 'K'};
 // ROOK: 0-3, BISHOP: 4-7, QUEEN and KING: 0-7;
 static const int8_t slideDirns[8] = {LEFT, RIGHT, UP, DOWN, UP_LEFT, UP_RIGHT, DOWN_LEFT, DOWN_RIGHT};
 static const int8_t knightDirns[8] = {UP+UP_LEFT, UP+UP_RIGHT, RIGHT+UP_RIGHT, RIGHT+DOWN_RIGHT, DOWN+DOWN_LEFT, DOWN+DOWN_RIGHT, LEFT+DOWN_LEFT, LEFT+UP_LEFT};
+#if !defined(BITBOARD) || defined(DEBUG)
 // PAWN: Forward: 0, Two-step: 1, Capture: 2-3, En passant: 4-5 (corresponding to 2-3, respectively)
 static const int8_t pawnDirnsBlack[6] = {DOWN, DOWN+DOWN, DOWN_LEFT, DOWN_RIGHT, LEFT, RIGHT};
 static const int8_t pawnDirnsWhite[6] = {UP, UP+UP, UP_LEFT, UP_RIGHT, LEFT, RIGHT};
+// PROMOTION: Promotable roles
+static const int8_t promotableRoles[4] = {BISHOP, KNIGHT, ROOK, QUEEN};
+#endif // !BITBOARD || DEBUG
 // CASTLING: Relative Rook positons: 0-1, Rook targets / Direction of King movement: 2-3, King targets: 4-5
 // In each pair, the Queenside is listed first.
 static const int8_t castlingSquares[6] = {4*LEFT, 3*RIGHT, LEFT, RIGHT, 2*LEFT, 2*RIGHT};
-// PROMOTION: Promotable roles
-static const int8_t promotableRoles[4] = {BISHOP, KNIGHT, ROOK, QUEEN};
 
 const struct State initialState = {
     .board = {
@@ -43,129 +43,44 @@ const struct State initialState = {
     }
 };
 
-#ifdef DEBUG
-// ===========================================================================
-// Performance tests (perft)
-// https://www.chessprogramming.org/Perft_Results
-// ===========================================================================
-static const struct State perft2 = {
-    .board = {
-        WHITE|ROOK, 0, 0, 0, WHITE|KING, 0, 0, WHITE|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
-        WHITE|PAWN, WHITE|PAWN, WHITE|PAWN, WHITE|BISHOP, WHITE|BISHOP, WHITE|PAWN, WHITE|PAWN, WHITE|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, WHITE|KNIGHT, 0, 0, WHITE|QUEEN, 0, BLACK|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, BLACK|PAWN, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, WHITE|PAWN, WHITE|KNIGHT, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|BISHOP, BLACK|KNIGHT, 0, 0, BLACK|PAWN, BLACK|KNIGHT, BLACK|PAWN, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|PAWN, 0, BLACK|PAWN, BLACK|PAWN, BLACK|QUEEN, BLACK|PAWN, BLACK|BISHOP, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|ROOK, 0, 0, 0, BLACK|KING, 0, 0, BLACK|ROOK,     0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-
-static const struct State perft3 = {
-    .board = {
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, WHITE|PAWN, 0, WHITE|PAWN, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, WHITE|ROOK, 0, 0, 0, BLACK|PAWN, 0, BLACK|KING|PIECE_MOVED,    0, 0, 0, 0, 0, 0, 0, 0,
-        WHITE|KING|PIECE_MOVED, WHITE|PAWN, 0, 0, 0, 0, 0, BLACK|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, BLACK|PAWN, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, BLACK|PAWN, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-
-static const struct State perft5 = {
-    .board = {
-        WHITE|ROOK, WHITE|KNIGHT, WHITE|BISHOP, WHITE|QUEEN, WHITE|KING, 0, 0, WHITE|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
-        WHITE|PAWN, WHITE|PAWN, WHITE|PAWN, 0, WHITE|KNIGHT, BLACK|KNIGHT, WHITE|PAWN, WHITE|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, WHITE|BISHOP, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, BLACK|PAWN, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|PAWN, BLACK|PAWN, 0, WHITE|PAWN, BLACK|BISHOP, BLACK|PAWN, BLACK|PAWN, BLACK|PAWN,     0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|ROOK, BLACK|KNIGHT, BLACK|BISHOP, BLACK|QUEEN, 0, BLACK|KING|PIECE_MOVED, 0, BLACK|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-
-static const struct State promo1 = {
-    .board = {
-        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-
-static const struct State promo2 = {
-    .board = {
-        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|KING, 0, 0, 0, BLACK|ROOK, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-
-static const struct State promo3 = {
-    .board = {
-        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|KING, 0, 0, BLACK|ROOK, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-static const struct State promo4 = {
-    .board = {
-        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        0, 0, 0, BLACK|PAWN, WHITE|PAWN, BLACK|PAWN, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-        BLACK|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
-    }
-};
-#endif // DEBUG
-
-// ===========================================================================
-// Static function declarations
-// ===========================================================================
-static uint8_t is_in_check(const struct State* s);
-
-// Populates m.algebra using its other fields.
-static void move_to_algebra(struct Move* m) {
+void move_to_algebra(const struct Move* m, char algebra[ALGEBRA_LEN]) {
     uint8_t i = 0;
     char role = roleSyms[m->role];
     if (role != 'p') {
-        m->algebra[i] = role;
+        algebra[i] = role;
         i++;
     }
-    from_0x88_to_coord(m->orig, m->algebra + i);
+    from_0x88_to_coord(m->orig, algebra + i);
     i += 2;
-    from_0x88_to_coord(m->dest, m->algebra + i);
+    from_0x88_to_coord(m->dest, algebra + i);
     i += 2;
     if (role == 'p' && m->promoRole) {
-        m->algebra[i] = roleSyms[m->promoRole];
+        algebra[i] = roleSyms[m->promoRole];
         i++;
     }
-    m->algebra[i] = 0;
+    algebra[i] = 0;
+}
+
+uint16_t pack_move(const struct Move* m) {
+    return TO_SQ64(m->orig) | (TO_SQ64(m->dest) << 6) | (m->promoRole << 12);
+}
+
+void unpack_move(const struct State* s, uint16_t packed, struct Move* m) {
+    m->orig = FROM_SQ64(packed & 0x3F);
+    m->dest = FROM_SQ64((packed >> 6) & 0x3F);
+    m->promoRole = packed >> 12;
+    m->role = ROLE(s->board[m->orig]);
+    m->valid = 1;
+    // A pawn moving diagonally onto a vacant square captures en passant
+    m->pieceCaptured = !IS_VACANT(s->board[m->dest]) || (m->role == PAWN && ((m->orig ^ m->dest) & 0x07));
 }
 
 void print_state(const struct State* s) {
-    if (s->lastMove.valid)
-        printf("%s, ", s->lastMove.algebra);
+    if (s->lastMove.valid) {
+        char algebra[ALGEBRA_LEN];
+        move_to_algebra(&s->lastMove, algebra);
+        printf("%s, ", algebra);
+    }
     if (BLACK_TO_MOVE(s))
         printf("black to move\n");
     else
@@ -217,10 +132,10 @@ void from_0x88(uint8_t pos, uint8_t* rank, uint8_t* file) {
 }
 
 uint8_t coord_to_0x88(char coord[2]) {
-    uint8_t f = tolower(coord[0]) - 'a' + 1;
+    uint8_t f = tolower(coord[0]) - 'a';
     uint8_t r = coord[1] - '1';
-    if (r < '1' || r > '7') return 0xFF;
-    if (f < 'a' || f > 'h') return 0xFF;
+    if (r > 7) return 0xFF;
+    if (f > 7) return 0xFF;
     return to_0x88(r, f);
 }
 
@@ -233,376 +148,810 @@ uint8_t from_0x88_to_coord(uint8_t pos, char coord[2]) {
     return 1;
 }
 
-// Allocates memory for a successor state
-static struct State* add_result(struct State* s) {
-    if (s->succ == NULL) {
-        s->cSucc = 48;
-        s->succ = malloc(s->cSucc * sizeof(struct State));
-    } else if (s->nSucc == s->cSucc) {
-        s->cSucc += 16;
-        s->succ = realloc(s->succ, s->cSucc * sizeof(struct State));
+// Whether byColour attacks sq, treating the square ignore as vacant.
+static uint8_t attacked_ignoring(const uint8_t board[128], uint8_t sq, uint8_t byColour, uint8_t ignore) {
+    // Pawns attack diagonally forward, so look diagonally backward from the square.
+    int8_t pawnBack = (byColour == BLACK) ? UP : DOWN;
+    for (int8_t side = LEFT; side <= RIGHT; side += 2) {
+        uint8_t pos = sq + pawnBack + side;
+        if (is_on_board(pos) && ROLE(board[pos]) == PAWN && (board[pos] & BLACK) == byColour)
+            return 1;
     }
+    for (uint8_t dirn = 0; dirn < 8; dirn++) {
+        // KNIGHT
+        uint8_t pos = sq + knightDirns[dirn];
+        if (is_on_board(pos) && ROLE(board[pos]) == KNIGHT && (board[pos] & BLACK) == byColour)
+            return 1;
+
+        // Look along the ray for the first piece: it attacks if it slides this way, or is an adjacent King.
+        pos = sq;
+        for (uint8_t dist = 1; ; dist++) {
+            pos += slideDirns[dirn];
+            if (!is_on_board(pos))
+                break;
+            uint8_t piece = board[pos];
+            if (IS_VACANT(piece) || pos == ignore)
+                continue;
+            if ((piece & BLACK) == byColour) {
+                uint8_t role = ROLE(piece);
+                if (role == QUEEN || (role == KING && dist == 1)
+                        || (role == ROOK && dirn <= 3) || (role == BISHOP && dirn >= 4))
+                    return 1;
+            }
+            break;
+        }
+    }
+    return 0;
+}
 
-    // Copy state
-    struct State* suc = &s->succ[s->nSucc];
-    memcpy(suc, s, sizeof(struct State));
+uint8_t is_square_attacked(const uint8_t board[128], uint8_t sq, uint8_t byColour) {
+    return attacked_ignoring(board, sq, byColour, 0xFF);
+}
 
-    return &s->succ[(s->nSucc)++];
+uint8_t find_king(const uint8_t board[128], uint8_t colour) {
+    // Step over the off-board half of each rank.
+    for (uint8_t pos = 0; pos < 128; pos = (pos + 9) & ~0x08) {
+        if (ROLE(board[pos]) == KING && (board[pos] & BLACK) == colour)
+            return pos;
+    }
+    return 0xFF;
 }
 
-// Adds states to successor if the piece can move according to m.
-static struct State* move_piece(struct State* s, struct Move* m) {
-    m->pieceCaptured = 0;
-    m->valid = 0;
+// ===========================================================================
+// Zobrist hashing
+// ===========================================================================
+// Indexed by piece_index(): vacant squares hash to zero.
+static uint64_t zobristPieces[13][64];
+// White Queenside, White Kingside, Black Queenside, Black Kingside
+static uint64_t zobristCastling[4];
+static uint64_t zobristEnPassant[8];
+static uint64_t zobristBlackToMove;
+
+static uint8_t piece_index(uint8_t piece) {
+    if (IS_VACANT(piece))
+        return 0;
+    return ROLE(piece) + (IS_BLACK(piece) ? 6 : 0);
+}
 
-    if (!is_on_board(m->dest)) {
-        return NULL;
+static uint64_t splitmix64(uint64_t* x) {
+    uint64_t z = (*x += 0x9E3779B97F4A7C15ULL);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    return z ^ (z >> 31);
+}
+
+static void zobrist_init(void) {
+    uint64_t x = 0x426F726973ULL; // Fixed seed: keys come out the same every run.
+    for (uint8_t p = 1; p < 13; p++) {
+        for (uint8_t sq = 0; sq < 64; sq++)
+            zobristPieces[p][sq] = splitmix64(&x);
     }
-    uint8_t tgt = s->board[m->dest];
-    if (IS_VACANT(tgt) || (BLACK_TO_MOVE(s) && IS_WHITE(tgt)) || (WHITE_TO_MOVE(s) && IS_BLACK(tgt))) {
-        // Get struct for new state.
-        struct State* suc = add_result(s);
-
-        // Move piece to either a vacant square or capture.
-        // Also record whether a piece has been moved before (for castling)
-        suc->board[m->dest] = s->board[m->orig] | PIECE_MOVED;
-        suc->board[m->orig] = 0;
-
-        // Update move number and information on last move
-        m->role = ROLE(s->board[m->orig]);
-        m->pieceCaptured = !IS_VACANT(s->board[m->dest]);
-        m->valid = 1;
-        m->promoRole = 0;
-        memcpy(&suc->lastMove, m, sizeof(struct Move));
-
-        suc->ply++;
-        suc->last = s;
-        suc->succ = NULL;
-        suc->cSucc = 0;
-        suc->nSucc = 0;
-        suc->castlesExpanded = 0;
-        suc->checksRemoved = 0;
-        
-        suc->winsB = 0;
-        suc->winsW = 0;
-        suc->draws = 0;
-
-        return suc;
-    }
-    return NULL;
-}
-
-static void slide_piece(struct State* s, uint8_t orig, int8_t dirn, uint8_t isKing) {
-    uint8_t dest = orig;
-    for(;;) {
-        dest += dirn;
-        struct Move m = {.orig = orig, .dest = dest};
-        move_piece(s, &m);
-        if (isKing || !m.valid || m.pieceCaptured) {
-            // The King is limited to one step anyway.
-            break;
+    for (uint8_t i = 0; i < 4; i++)
+        zobristCastling[i] = splitmix64(&x);
+    for (uint8_t i = 0; i < 8; i++)
+        zobristEnPassant[i] = splitmix64(&x);
+    zobristBlackToMove = splitmix64(&x);
+}
+
+// The part of the key that is not piece placement.
+// Read off the board rather than kept incrementally, as flags change in several places.
+static uint64_t rights_key(const struct State* s) {
+    uint64_t key = BLACK_TO_MOVE(s) ? zobristBlackToMove : 0;
+
+    // Castling: neither the King nor that corner's Rook has moved.
+    for (uint8_t i = 0; i < 2; i++) {
+        uint8_t colour = i ? BLACK : WHITE;
+        uint8_t home = i ? 0x74 : 0x04;
+        uint8_t king = s->board[home];
+        if (ROLE(king) != KING || IS_PIECE_MOVED(king) || (king & BLACK) != colour)
+            continue;
+        for (uint8_t side = 0; side < 2; side++) {
+            uint8_t rook = s->board[home + castlingSquares[side]];
+            if (ROLE(rook) == ROOK && !IS_PIECE_MOVED(rook) && (rook & BLACK) == colour)
+                key ^= zobristCastling[i * 2 + side];
         }
     }
+
+    // En passant: only when a pawn stands beside the one that just made a two-step.
+    uint8_t dest = s->lastMove.dest;
+    uint8_t pawn = s->board[dest];
+    if (ROLE(pawn) == PAWN && IS_PAWN_TWO_STEP(pawn)) {
+        for (int8_t side = LEFT; side <= RIGHT; side += 2) {
+            uint8_t pos = dest + side;
+            if (is_on_board(pos) && ROLE(s->board[pos]) == PAWN && (s->board[pos] & BLACK) != (pawn & BLACK)) {
+                key ^= zobristEnPassant[dest & 0x07];
+                break;
+            }
+        }
+    }
+    return key;
 }
 
-// Checks a state for a pawn that is due to be promoted.
-// m is already populated with the origin and destination squares.
-// If eligible, it will be copied for each role and returned in result.
-static void move_pawn_and_check_promotion(struct State* s, struct Move *m) {
-    uint8_t destRank, destFile;
-    from_0x88(m->dest, &destRank, &destFile);
-    m->promoRole = 0;
-    if ((BLACK_TO_MOVE(s) && destRank == 0) || (WHITE_TO_MOVE(s) && destRank == 7)) {
-        // This pawn can be promoted!
-        // There should be a successor state for each role.
-        for (uint8_t i = 0; i < 4; i++) {
-            m->promoRole = promotableRoles[i];
-            struct State* succ = move_piece(s, m);
-            succ->board[m->dest] &= ~0x07;
-            succ->board[m->dest] |= promotableRoles[i];
+uint64_t zobrist_key(const struct State* s) {
+    uint64_t key = rights_key(s);
+    for (uint8_t sq = 0; sq < 64; sq++)
+        key ^= zobristPieces[piece_index(s->board[FROM_SQ64(sq)])][sq];
+    return key;
+}
+
+// ===========================================================================
+// Static evaluation
+// ===========================================================================
+static const int16_t roleValues[7] = {0, 100, 500, 320, 330, 900, 0};
+
+// Piece-square tables for White, rank 8 first as the board is usually drawn.
+// From Tomasz Michniewski's Simplified Evaluation Function.
+static const int8_t pieceSquareTables[7][64] = {
+    [PAWN] = {
+         0,   0,   0,   0,   0,   0,   0,   0,
+        50,  50,  50,  50,  50,  50,  50,  50,
+        10,  10,  20,  30,  30,  20,  10,  10,
+         5,   5,  10,  25,  25,  10,   5,   5,
+         0,   0,   0,  20,  20,   0,   0,   0,
+         5,  -5, -10,   0,   0, -10,  -5,   5,
+         5,  10,  10, -20, -20,  10,  10,   5,
+         0,   0,   0,   0,   0,   0,   0,   0,
+    },
+    [ROOK] = {
+         0,   0,   0,   0,   0,   0,   0,   0,
+         5,  10,  10,  10,  10,  10,  10,   5,
+        -5,   0,   0,   0,   0,   0,   0,  -5,
+        -5,   0,   0,   0,   0,   0,   0,  -5,
+        -5,   0,   0,   0,   0,   0,   0,  -5,
+        -5,   0,   0,   0,   0,   0,   0,  -5,
+        -5,   0,   0,   0,   0,   0,   0,  -5,
+         0,   0,   0,   5,   5,   0,   0,   0,
+    },
+    [KNIGHT] = {
+       -50, -40, -30, -30, -30, -30, -40, -50,
+       -40, -20,   0,   0,   0,   0, -20, -40,
+       -30,   0,  10,  15,  15,  10,   0, -30,
+       -30,   5,  15,  20,  20,  15,   5, -30,
+       -30,   0,  15,  20,  20,  15,   0, -30,
+       -30,   5,  10,  15,  15,  10,   5, -30,
+       -40, -20,   0,   5,   5,   0, -20, -40,
+       -50, -40, -30, -30, -30, -30, -40, -50,
+    },
+    [BISHOP] = {
+       -20, -10, -10, -10, -10, -10, -10, -20,
+       -10,   0,   0,   0,   0,   0,   0, -10,
+       -10,   0,   5,  10,  10,   5,   0, -10,
+       -10,   5,   5,  10,  10,   5,   5, -10,
+       -10,   0,  10,  10,  10,  10,   0, -10,
+       -10,  10,  10,  10,  10,  10,  10, -10,
+       -10,   5,   0,   0,   0,   0,   5, -10,
+       -20, -10, -10, -10, -10, -10, -10, -20,
+    },
+    [QUEEN] = {
+       -20, -10, -10,  -5,  -5, -10, -10, -20,
+       -10,   0,   0,   0,   0,   0,   0, -10,
+       -10,   0,   5,   5,   5,   5,   0, -10,
+        -5,   0,   5,   5,   5,   5,   0,  -5,
+         0,   0,   5,   5,   5,   5,   0,  -5,
+       -10,   5,   5,   5,   5,   5,   0, -10,
+       -10,   0,   5,   0,   0,   0,   0, -10,
+       -20, -10, -10,  -5,  -5, -10, -10, -20,
+    },
+    [KING] = {
+       -30, -40, -40, -50, -50, -40, -40, -30,
+       -30, -40, -40, -50, -50, -40, -40, -30,
+       -30, -40, -40, -50, -50, -40, -40, -30,
+       -30, -40, -40, -50, -50, -40, -40, -30,
+       -20, -30, -30, -40, -40, -30, -30, -20,
+       -10, -20, -20, -20, -20, -20, -20, -10,
+        20,  20,   0,   0,   0,   0,  20,  20,
+        20,  30,  10,   0,   0,  10,  30,  20,
+    },
+};
+
+// Indexed like zobristPieces: what a piece on a square adds to White's score.
+static int16_t pieceScores[13][64];
+
+static void eval_init(void) {
+    for (uint8_t role = PAWN; role <= KING; role++) {
+        for (uint8_t sq = 0; sq < 64; sq++) {
+            uint8_t rank = sq >> 3, file = sq & 0x07;
+            // Black's tables are White's, mirrored top to bottom.
+            pieceScores[role][sq] = roleValues[role] + pieceSquareTables[role][(7 - rank) * 8 + file];
+            pieceScores[role + 6][sq] = -(roleValues[role] + pieceSquareTables[role][rank * 8 + file]);
         }
-    } else {
-        m->promoRole = 0;
-        move_piece(s, m);
     }
 }
 
-void clean_up_successors(struct State* s, const struct State* dontfree) {
-    if (s->succ) {
-        for (uint8_t i = 0; i < s->nSucc; i++) {
-            if (&s->succ[i] != dontfree)
-                clean_up_successors(&s->succ[i], dontfree);
+int16_t evaluate(const struct State* s) {
+    int16_t eval = 0;
+    for (uint8_t sq = 0; sq < 64; sq++)
+        eval += pieceScores[piece_index(s->board[FROM_SQ64(sq)])][sq];
+    return eval;
+}
+
+void board_init(void) {
+    zobrist_init();
+    eval_init();
+}
+
+void refresh_state(struct State* s) {
+    s->key = zobrist_key(s);
+    s->eval = evaluate(s);
+#ifdef BITBOARD
+    bb_from_state(s, &s->bb);
+#endif // BITBOARD
+}
+
+// ===========================================================================
+// Making and unmaking moves
+// ===========================================================================
+// Overwrites a square, remembering its old contents for unmake_move().
+static void set_square(struct State* s, struct Undo* u, uint8_t pos, uint8_t piece) {
+    u->pos[u->n] = pos;
+    u->piece[u->n] = s->board[pos];
+    u->n++;
+    uint8_t before = piece_index(s->board[pos]), after = piece_index(piece), sq = TO_SQ64(pos);
+    s->key ^= zobristPieces[before][sq] ^ zobristPieces[after][sq];
+    s->eval += pieceScores[after][sq] - pieceScores[before][sq];
+#ifdef BITBOARD
+    bb_replace(&s->bb, sq, s->board[pos], piece);
+#endif // BITBOARD
+    s->board[pos] = piece;
+}
+
+void make_move(struct State* s, const struct Move* m, struct Undo* u) {
+    u->n = 0;
+    memcpy(&u->lastMove, &s->lastMove, sizeof(struct Move));
+    u->key = s->key;
+    u->eval = s->eval;
+    u->halfmoveClock = s->halfmoveClock;
+    s->key ^= rights_key(s);
+
+    // The opponent's last move can no longer be captured en passant.
+    if (s->lastMove.valid && s->lastMove.role == PAWN && IS_PAWN_TWO_STEP(s->board[s->lastMove.dest]))
+        set_square(s, u, s->lastMove.dest, s->board[s->lastMove.dest] & ~PAWN_TWO_STEP);
+
+    // Move piece to either a vacant square or capture.
+    // Also record whether a piece has been moved before (for castling)
+    uint8_t piece = s->board[m->orig] | PIECE_MOVED;
+    if (m->role == PAWN) {
+        int8_t step = m->dest - m->orig;
+        if (step == UP+UP || step == DOWN+DOWN) {
+            piece |= PAWN_TWO_STEP; // For en passant
+        } else if (((m->orig ^ m->dest) & 0x07) && IS_VACANT(s->board[m->dest])) {
+            // En passant: remove the pawn beside the origin square
+            set_square(s, u, (m->orig & 0x70) | (m->dest & 0x07), 0);
         }
-        free(s->succ);
-        s->succ = NULL;
-        s->cSucc = 0;
-        s->nSucc = 0;
-        s->castlesExpanded = 0;
-        s->checksRemoved = 0;
+        if (m->promoRole)
+            piece = (piece & BLACK) | m->promoRole | PIECE_MOVED;
+    } else if (m->role == KING && (m->dest == m->orig + castlingSquares[4] || m->dest == m->orig + castlingSquares[5])) {
+        // Castling: move the Rook over the King as well
+        uint8_t side = m->dest > m->orig;
+        set_square(s, u, m->orig + castlingSquares[side + 2], s->board[m->orig + castlingSquares[side + 0]] | PIECE_MOVED);
+        set_square(s, u, m->orig + castlingSquares[side + 0], 0);
     }
+    set_square(s, u, m->dest, piece);
+    set_square(s, u, m->orig, 0);
+
+    memcpy(&s->lastMove, m, sizeof(struct Move));
+    s->ply++;
+    s->key ^= rights_key(s);
+    if (m->role == PAWN || m->pieceCaptured)
+        s->halfmoveClock = 0;
+    else if (s->halfmoveClock < UINT8_MAX)
+        s->halfmoveClock++;
 }
 
-static void get_moves(struct State* s, uint8_t expandCastles) {
-    // No need to do this again
-    if (s->castlesExpanded)
+void unmake_move(struct State* s, const struct Undo* u) {
+    for (int8_t i = u->n - 1; i >= 0; i--) {
+#ifdef BITBOARD
+        bb_replace(&s->bb, TO_SQ64(u->pos[i]), s->board[u->pos[i]], u->piece[i]);
+#endif // BITBOARD
+        s->board[u->pos[i]] = u->piece[i];
+    }
+    memcpy(&s->lastMove, &u->lastMove, sizeof(struct Move));
+    s->key = u->key;
+    s->eval = u->eval;
+    s->halfmoveClock = u->halfmoveClock;
+    s->ply--;
+}
+
+uint8_t count_repetitions(const struct State* s, const uint64_t* history, int n) {
+    // Same player to move: every other position back, as far as the last irreversible move.
+    uint8_t count = 0;
+    int oldest = n - s->halfmoveClock;
+    for (int i = n - 2; i >= 0 && i >= oldest; i -= 2) {
+        if (history[i] == s->key && ++count == 2)
+            break;
+    }
+    return count;
+}
+
+uint8_t is_draw_by_rule(const struct State* s, const uint64_t* history, int n) {
+    return s->halfmoveClock >= FIFTY_MOVE_PLIES || count_repetitions(s, history, n) >= 2;
+}
+
+uint8_t is_in_check(const struct State* s) {
+    uint8_t colour = BLACK_TO_MOVE(s) ? BLACK : WHITE;
+    uint8_t king = find_king(s->board, colour);
+    return is_on_board(king) && is_square_attacked(s->board, king, colour ^ BLACK);
+}
+
+// ===========================================================================
+// 0x88 move generator
+// Bitboard builds only keep it in debug builds, to verify the other backend against.
+// ===========================================================================
+#if !defined(BITBOARD) || defined(DEBUG)
+// Sets of squares, one bit per on-board 0x88 position.
+#define SQUARE_BIT(pos) (1ULL << TO_SQ64(pos))
+#define ALL_SQUARES (~0ULL)
+
+// Everything worked out about the position before generating moves.
+struct GenContext {
+    const struct State* s;
+    struct Move* out;
+    uint8_t n;
+    uint8_t colour; // Colour of the player to move
+    uint8_t king;   // Position of their King, 0xFF if there is none.
+    uint8_t nCheckers;
+    // Squares a move other than the King's must land on: everywhere, or onto or in front of the checking piece.
+    uint64_t evasions;
+    // Pieces pinned against the King, and the squares along each pin they may still move to.
+    uint8_t nPins;
+    uint8_t pinPos[8];
+    uint64_t pinRay[8];
+};
+
+// Squares the piece on orig may move to without exposing or ignoring a check.
+static uint64_t allowed_squares(const struct GenContext* g, uint8_t orig) {
+    for (uint8_t i = 0; i < g->nPins; i++) {
+        if (g->pinPos[i] == orig)
+            return g->evasions & g->pinRay[i];
+    }
+    return g->evasions;
+}
+
+// Finds the pieces checking the King and those pinned to it, by looking outward from the King.
+static void find_checks_and_pins(struct GenContext* g) {
+    const uint8_t* board = g->s->board;
+    uint8_t opponent = g->colour ^ BLACK;
+    g->nCheckers = 0;
+    g->evasions = ALL_SQUARES;
+    g->nPins = 0;
+    if (!is_on_board(g->king))
         return;
 
-    struct State* succ = NULL;
-    uint8_t firstCall = (s->nSucc == 0); // First call of this function for this state.
+    uint64_t checks = 0;
+    // Pawns attack diagonally forward, so look diagonally forward from the King.
+    int8_t pawnForward = (g->colour == BLACK) ? DOWN : UP;
+    for (int8_t side = LEFT; side <= RIGHT; side += 2) {
+        uint8_t pos = g->king + pawnForward + side;
+        if (is_on_board(pos) && ROLE(board[pos]) == PAWN && (board[pos] & BLACK) == opponent) {
+            checks |= SQUARE_BIT(pos);
+            g->nCheckers++;
+        }
+    }
+    for (uint8_t dirn = 0; dirn < 8; dirn++) {
+        // KNIGHT
+        uint8_t pos = g->king + knightDirns[dirn];
+        if (is_on_board(pos) && ROLE(board[pos]) == KNIGHT && (board[pos] & BLACK) == opponent) {
+            checks |= SQUARE_BIT(pos);
+            g->nCheckers++;
+        }
 
-    for (int8_t r = 0; r < 8; r++)
-    for (int8_t f = 0; f < 8; f++) {
-        uint8_t orig = to_0x88(r, f);
-        // CHECK colour, square not empty
-        uint8_t piece = s->board[orig];
-        if (!piece) continue;
-        if ((BLACK_TO_MOVE(s) && IS_WHITE(piece)) || (WHITE_TO_MOVE(s) && IS_BLACK(piece))) continue;
-
-        if (firstCall) {
-            // ROOK
-            if (ROLE(piece) == ROOK) {
-                for (int8_t dirn = 0; dirn <= 3; dirn++) {
-                    slide_piece(s, orig, slideDirns[dirn], 0);
-                }
-            }
-            // BISHOP
-            if (ROLE(piece) == BISHOP) {
-                for (int8_t dirn = 4; dirn <= 7; dirn++) {
-                    slide_piece(s, orig, slideDirns[dirn], 0);
-                }
+        // Sliders: the first piece along the ray checks; behind one of our own, it pins.
+        uint64_t ray = 0;
+        uint8_t blocker = 0xFF;
+        for (pos = g->king + slideDirns[dirn]; is_on_board(pos); pos += slideDirns[dirn]) {
+            ray |= SQUARE_BIT(pos);
+            uint8_t piece = board[pos];
+            if (IS_VACANT(piece))
+                continue;
+            if ((piece & BLACK) == g->colour) {
+                if (blocker != 0xFF)
+                    break; // Two of our own pieces in the way
+                blocker = pos;
+                continue;
             }
-            // QUEEN
-            if (ROLE(piece) == QUEEN) {
-                for (int8_t dirn = 0; dirn <= 7; dirn++) {
-                    slide_piece(s, orig, slideDirns[dirn], 0);
+            uint8_t role = ROLE(piece);
+            if (role == QUEEN || (role == ROOK && dirn <= 3) || (role == BISHOP && dirn >= 4)) {
+                if (blocker == 0xFF) {
+                    checks |= ray;
+                    g->nCheckers++;
+                } else {
+                    g->pinPos[g->nPins] = blocker;
+                    g->pinRay[g->nPins] = ray;
+                    g->nPins++;
                 }
             }
-            // KING
-            if (ROLE(piece) == KING) {
-                for (int8_t dirn = 0; dirn <= 7; dirn++) {
-                    slide_piece(s, orig, slideDirns[dirn], 1);
-                }
-            }
-            // KNIGHT
-            if (ROLE(piece) == KNIGHT) {
-                for (int8_t dirn = 0; dirn < 8; dirn++) {
-                    uint8_t dest = orig + knightDirns[dirn];
-                    struct Move m = {.orig = orig, .dest = dest};
-                    move_piece(s, &m);
-                }
-            }
-            // PAWN
-            if (ROLE(piece) == PAWN) {
-                // Clear the two-step flag from the last move
-                if ((BLACK_TO_MOVE(s) && IS_BLACK(piece)) || (WHITE_TO_MOVE(s) && IS_WHITE(piece))) {
-                    s->board[orig] &= ~PAWN_TWO_STEP;
-                }
+            break;
+        }
+    }
+    if (g->nCheckers)
+        g->evasions = checks;
+}
 
-                struct Move m;
-                m.orig = orig;
-                const int8_t* pawnDirns = BLACK_TO_MOVE(s) ? pawnDirnsBlack : pawnDirnsWhite;
-
-                // Square in front is clear: move forward one or two ranks.
-                m.dest = orig + pawnDirns[0];
-                if (is_on_board(m.dest) && IS_VACANT(s->board[m.dest])) {
-                    move_pawn_and_check_promotion(s, &m);
-
-                    // Two-step
-                    m.dest = orig + pawnDirns[1];
-                    if (is_on_board(m.dest) && IS_VACANT(s->board[m.dest]))
-                    if ((BLACK_TO_MOVE(s) && r == 6) || (WHITE_TO_MOVE(s) && r == 1)) {
-                        succ = move_piece(s, &m);
-                        succ->board[m.dest] |= PAWN_TWO_STEP; // For en passant
-                    }
-                }
+static void add_move(struct GenContext* g, uint8_t orig, uint8_t dest, uint8_t promoRole) {
+    struct Move* m = &g->out[g->n++];
+    m->orig = orig;
+    m->dest = dest;
+    m->role = ROLE(g->s->board[orig]);
+    m->valid = 1;
+    // A pawn moving diagonally onto a vacant square captures en passant
+    m->pieceCaptured = !IS_VACANT(g->s->board[dest]) || (m->role == PAWN && ((orig ^ dest) & 0x07));
+    m->promoRole = promoRole;
+}
 
-                for (uint8_t i = 2; i <= 3; i++) {
-                    // Capture: Square along diagonal contains a piece of opposite colour.
-                    m.dest = orig + pawnDirns[i];
-                    uint8_t tgt = s->board[m.dest];
-                    if ((BLACK_TO_MOVE(s) && IS_WHITE(tgt)) || (WHITE_TO_MOVE(s) && IS_BLACK(tgt))) {
-                        move_pawn_and_check_promotion(s, &m);
-                    }
-
-                    // En passant: Check rank and pieces beside and clear destination.
-                    // m.dest is the same value used for normal capture above.
-                    uint8_t adjacent = s->board[orig + pawnDirns[i + 2]];
-                    if ((BLACK_TO_MOVE(s) && r == 3 && IS_WHITE(adjacent)) || (WHITE_TO_MOVE(s) && r == 4 && IS_BLACK(adjacent)))
-                    if (IS_VACANT(tgt) && ROLE(adjacent) == PAWN && IS_PAWN_TWO_STEP(adjacent)) {
-                        succ = move_piece(s, &m);
-                        // Additionally, remove en passant-ed piece
-                        if (succ != NULL)
-                            succ->board[orig + pawnDirns[i + 2]] = 0;
-                    }
-                }
+static void slide_piece(struct GenContext* g, uint8_t orig, int8_t dirn, uint64_t allowed) {
+    for (uint8_t dest = orig + dirn; is_on_board(dest); dest += dirn) {
+        uint8_t tgt = g->s->board[dest];
+        if (!IS_VACANT(tgt) && (tgt & BLACK) == g->colour)
+            break;
+        if (allowed & SQUARE_BIT(dest))
+            add_move(g, orig, dest, 0);
+        if (!IS_VACANT(tgt))
+            break;
+    }
+}
+
+// Adds a pawn move, or one move for each role if the pawn is due to be promoted.
+static void move_pawn_and_check_promotion(struct GenContext* g, uint8_t orig, uint8_t dest) {
+    uint8_t destRank, destFile;
+    from_0x88(dest, &destRank, &destFile);
+    if ((g->colour == BLACK && destRank == 0) || (g->colour == WHITE && destRank == 7)) {
+        // This pawn can be promoted!
+        for (uint8_t i = 0; i < 4; i++)
+            add_move(g, orig, dest, promotableRoles[i]);
+    } else {
+        add_move(g, orig, dest, 0);
+    }
+}
+
+// En passant removes two pieces from a rank at once, which the pin rays do not account for.
+// Play it out on a copy of the board instead.
+static uint8_t en_passant_is_legal(const struct GenContext* g, uint8_t orig, uint8_t dest) {
+    if (!is_on_board(g->king))
+        return 1;
+    uint8_t board[128];
+    memcpy(board, g->s->board, sizeof(board));
+    board[dest] = board[orig];
+    board[orig] = 0;
+    board[(orig & 0x70) | (dest & 0x07)] = 0;
+    return !is_square_attacked(board, g->king, g->colour ^ BLACK);
+}
+
+static void get_king_moves(struct GenContext* g, uint8_t orig) {
+    const struct State* s = g->s;
+    uint8_t opponent = g->colour ^ BLACK;
+    for (int8_t dirn = 0; dirn <= 7; dirn++) {
+        uint8_t dest = orig + slideDirns[dirn];
+        if (!is_on_board(dest))
+            continue;
+        uint8_t tgt = s->board[dest];
+        if (!IS_VACANT(tgt) && (tgt & BLACK) == g->colour)
+            continue;
+        // The King must not stay on a line it is being checked along, so it is ignored as a blocker.
+        if (!attacked_ignoring(s->board, dest, opponent, orig))
+            add_move(g, orig, dest, 0);
+    }
+
+    // CASTLING
+    // Ensure King has not moved and not in check, then check each side
+    if (IS_PIECE_MOVED(s->board[orig]) || g->nCheckers)
+        return;
+    for (uint8_t side = 0; side < 2; side++) { // 0: Queenside, 1: Kingside
+        uint8_t cornerPiece = s->board[orig + castlingSquares[side + 0]];
+        if (IS_VACANT(cornerPiece) || (cornerPiece & BLACK) != g->colour)
+            continue;
+        if ((ROLE(cornerPiece) != ROOK) || IS_PIECE_MOVED(cornerPiece))
+            continue;
+        // There are no pieces in between. Check squares starting from King, working over to Rook.
+        uint8_t obstruction = 0;
+        for (uint8_t checkPosn = orig + castlingSquares[side + 2]; checkPosn != orig + castlingSquares[side + 0];
+                checkPosn += castlingSquares[side + 2]) {
+            if (ROLE(s->board[checkPosn]) != NO_ROLE) {
+                obstruction = 1;
+                break;
             }
         }
-        if (expandCastles && !s->castlesExpanded) {
-            // CASTLING
-            if (ROLE(piece) == KING) {
-                // Ensure King has not moved and not in check, then check each side
-                if(!IS_PIECE_MOVED(piece) && !is_in_check(s))
-                for (uint8_t side = 0; side < 2; side++) { // 0: Queenside, 1: Kingside
-                    uint8_t cornerPiece = s->board[orig + castlingSquares[side + 0]];
-                    if ((BLACK_TO_MOVE(s) && IS_BLACK(cornerPiece)) || (WHITE_TO_MOVE(s) && IS_WHITE(cornerPiece)))
-                    if ((ROLE(cornerPiece) == ROOK) && !IS_PIECE_MOVED(cornerPiece)) {
-                        // There are no pieces in between. Check squares starting from King, working over to Rook.
-                        uint8_t obstruction = 0;
-                        for (uint8_t checkPosn = orig + castlingSquares[side + 2]; checkPosn != orig + castlingSquares[side + 0];
-                                checkPosn += castlingSquares[side + 2]) {
-                            if (ROLE(s->board[checkPosn]) != NO_ROLE) {
-                                obstruction = 1;
-                                break;
-                            }
-                        }
-                        if (!obstruction) {
-                            // The King does not pass through a square that is in check. Check by temporarily moving the King.
-                            uint8_t tempPiece = s->board[orig];
-                            s->board[orig + castlingSquares[side + 2]] = tempPiece;
-                            s->board[orig] = 0;
-                            uint8_t danger = is_in_check(s);
-                            s->board[orig + castlingSquares[side + 2]] = 0;
-                            s->board[orig] = tempPiece;
-                            if (!danger) {
-                                // Move the King and Rook to Castle.
-                                struct Move m = {.orig = orig, .dest = orig + castlingSquares[side + 4]};
-                                struct State* succ = move_piece(s, &m);
-                                if (succ != NULL) {
-                                    succ->board[orig + castlingSquares[side + 2]] = succ->board[orig + castlingSquares[side + 0]];
-                                    succ->board[orig + castlingSquares[side + 0]] = 0;
-                                }
-                            }
-                        }
-                    }
-                }
-                s->castlesExpanded = 1;
-            }
+        // The King does not pass through or land on a square that is in check.
+        if (!obstruction && !is_square_attacked(s->board, orig + castlingSquares[side + 2], opponent)
+                && !is_square_attacked(s->board, orig + castlingSquares[side + 4], opponent)) {
+            // Move the King (and with it the Rook) to Castle.
+            add_move(g, orig, orig + castlingSquares[side + 4], 0);
         }
     }
 }
 
-static uint8_t king_captured(const struct State* s) {
-    for (uint8_t i = 0; i < 128; i++) {
-        if (ROLE(s->board[i]) == KING)
-        if ((WHITE_TO_MOVE(s) && IS_WHITE(s->board[i])) || (BLACK_TO_MOVE(s) && IS_BLACK(s->board[i]))) {
-            return 0;
+static void get_pawn_moves(struct GenContext* g, uint8_t orig, uint8_t rank, uint64_t allowed) {
+    const struct State* s = g->s;
+    const int8_t* pawnDirns = (g->colour == BLACK) ? pawnDirnsBlack : pawnDirnsWhite;
+
+    // Square in front is clear: move forward one or two ranks.
+    uint8_t dest = orig + pawnDirns[0];
+    if (is_on_board(dest) && IS_VACANT(s->board[dest])) {
+        if (allowed & SQUARE_BIT(dest))
+            move_pawn_and_check_promotion(g, orig, dest);
+
+        // Two-step
+        dest = orig + pawnDirns[1];
+        if (is_on_board(dest) && IS_VACANT(s->board[dest]) && (allowed & SQUARE_BIT(dest)))
+        if ((g->colour == BLACK && rank == 6) || (g->colour == WHITE && rank == 1)) {
+            add_move(g, orig, dest, 0);
         }
     }
-    return 1;
-}
 
-// Return whether this successor state (su, opponent to move) leaves the King in check.
-// That is, whether the opponent has a move that can capture the King.
-static uint8_t is_in_check_su(struct State* su) {
-    uint8_t result = 0;
-    get_moves(su, 0);
-    for (uint8_t i = 0; i < su->nSucc; i++) {
-        // See if for s' there exists a s'' that has the King captured
-        if (king_captured(&su->succ[i])) {
-            result = 1;
+    for (uint8_t i = 2; i <= 3; i++) {
+        // Capture: Square along diagonal contains a piece of opposite colour.
+        dest = orig + pawnDirns[i];
+        if (!is_on_board(dest)) continue;
+        uint8_t tgt = s->board[dest];
+        if (!IS_VACANT(tgt) && (tgt & BLACK) != g->colour && (allowed & SQUARE_BIT(dest))) {
+            move_pawn_and_check_promotion(g, orig, dest);
+        }
+
+        // En passant: Check rank and pieces beside and clear destination.
+        uint8_t adjacent = s->board[orig + pawnDirns[i + 2]];
+        if ((g->colour == BLACK && rank == 3 && IS_WHITE(adjacent)) || (g->colour == WHITE && rank == 4 && IS_BLACK(adjacent)))
+        if (IS_VACANT(tgt) && ROLE(adjacent) == PAWN && IS_PAWN_TWO_STEP(adjacent)) {
+            if (en_passant_is_legal(g, orig, dest))
+                add_move(g, orig, dest, 0);
         }
     }
-    clean_up_successors(su, NULL);
-    return result;
-}
-
-// Return whether the player to move is in check
-static uint8_t is_in_check(const struct State* s) {
-    // Another state where the player has 'passed' their move
-    struct State su;
-    memcpy(&su, s, sizeof(struct State));
-    bzero(&su.lastMove, sizeof(struct Move));
-    su.succ = NULL; // Clear successor states
-    su.cSucc = 0;
-    su.nSucc = 0;
-    su.castlesExpanded = 0;
-    su.checksRemoved = 0;
-    su.ply++;
-
-    return is_in_check_su(&su);
-}
-
-static void remove_check(struct State* s) {
-    if (s->checksRemoved) return;
-    if (s->succ == NULL) return;
-    for (int8_t i = 0; i < s->nSucc; i++) {
-        if (is_in_check_su(&s->succ[i])) {
-            // Take element from end of array and replace here.
-            memcpy(&s->succ[i], &s->succ[s->nSucc - 1], sizeof(struct State));
-            s->nSucc--;
-            i--; // This replacing element needs to be checked again
+}
+
+// Only legal moves are generated: checks and pins are found first, and every move is made to respect them.
+static uint8_t generate_moves_0x88(const struct State* s, struct Move* out) {
+    struct GenContext g = {.s = s, .out = out, .n = 0, .colour = BLACK_TO_MOVE(s) ? BLACK : WHITE};
+    g.king = find_king(s->board, g.colour);
+    find_checks_and_pins(&g);
+
+    if (is_on_board(g.king))
+        get_king_moves(&g, g.king);
+    // In double check, only the King can move.
+    if (g.nCheckers >= 2)
+        return g.n;
+
+    for (int8_t r = 0; r < 8; r++)
+    for (int8_t f = 0; f < 8; f++) {
+        uint8_t orig = to_0x88(r, f);
+        // CHECK colour, square not empty
+        uint8_t piece = s->board[orig];
+        if (IS_VACANT(piece) || (piece & BLACK) != g.colour) continue;
+        uint8_t role = ROLE(piece);
+        if (role == KING) continue;
+        uint64_t allowed = allowed_squares(&g, orig);
+
+        // ROOK, BISHOP and QUEEN
+        if (role == ROOK || role == QUEEN) {
+            for (int8_t dirn = 0; dirn <= 3; dirn++) {
+                slide_piece(&g, orig, slideDirns[dirn], allowed);
+            }
+        }
+        if (role == BISHOP || role == QUEEN) {
+            for (int8_t dirn = 4; dirn <= 7; dirn++) {
+                slide_piece(&g, orig, slideDirns[dirn], allowed);
+            }
+        }
+        // KNIGHT
+        if (role == KNIGHT) {
+            for (int8_t dirn = 0; dirn < 8; dirn++) {
+                uint8_t dest = orig + knightDirns[dirn];
+                if (is_on_board(dest) && (IS_VACANT(s->board[dest]) || (s->board[dest] & BLACK) != g.colour))
+                if (allowed & SQUARE_BIT(dest))
+                    add_move(&g, orig, dest, 0);
+            }
+        }
+        // PAWN
+        if (role == PAWN) {
+            get_pawn_moves(&g, orig, r, allowed);
         }
     }
-    s->checksRemoved = 1;
+    return g.n;
+}
+#endif // !BITBOARD || DEBUG
+
+uint8_t generate_moves(const struct State* s, struct Move* out) {
+#ifdef BITBOARD
+    return bb_generate_moves(s, out);
+#else
+    return generate_moves_0x88(s, out);
+#endif // BITBOARD
 }
 
-void get_legal_moves(struct State* s) {
-    get_moves(s, 1);
-    remove_check(s);
-    if (is_in_check(s))
-        s->check = 1;
-    for (uint8_t i = 0; i < s->nSucc; i++) {
-        move_to_algebra(&s->succ[i].lastMove);
+#if defined(DEBUG) && defined(BITBOARD)
+// Whether a move with the same squares and promotion appears in the list.
+static uint8_t has_move(const struct Move* moves, uint8_t n, const struct Move* m) {
+    for (uint8_t i = 0; i < n; i++) {
+        if (moves[i].orig == m->orig && moves[i].dest == m->dest && moves[i].promoRole == m->promoRole)
+            return 1;
     }
+    return 0;
 }
 
-void save_game(const struct State* s, const char* gamefn) {
-    int gamef;
+uint8_t verify_legal_moves(const struct State* s) {
+    struct Move bbMoves[MAX_MOVES], moves[MAX_MOVES];
+    uint8_t nbb = bb_generate_moves(s, bbMoves);
+    uint8_t n = generate_moves_0x88(s, moves);
 
-    gamef = open(gamefn, O_CREAT | O_WRONLY, 0666);
-    if (gamef < 0)
-        warn("open(): Error saving game");
-    if (write(gamef, s, sizeof(struct State)) < 0)
-        warn("write(): Error saving game");
-    close(gamef);
+    // Every move must appear in both.
+    uint8_t match = (n == nbb);
+    for (uint8_t i = 0; i < nbb && match; i++) {
+        match = has_move(moves, n, &bbMoves[i]);
+    }
+    if (!match) {
+        printf("Move generators disagree (bitboard: %d moves, 0x88: %d moves):\n", nbb, n);
+        print_state(s);
+    }
+    return match;
 }
+#endif // DEBUG && BITBOARD
 
-void load_game(struct State* s, const char* gamefn) {
-    int gamef;
-
-    gamef = open(gamefn, O_RDONLY, 0666);
-    if (gamef < 0)
-        warn("open(): Error loading game");
-    if (read(gamef, s, sizeof(struct State)) < 0)
-        warn("read(): Error loading game");
-    close(gamef);
+// ===========================================================================
+// Forsyth-Edwards Notation
+// ===========================================================================
+// Indexed by role, lower case
+static const char fenSyms[7] = {' ', 'p', 'r', 'n', 'b', 'q', 'k'};
 
-    // Clear references to successor states
-    s->castlesExpanded = 0;
-    s->checksRemoved = 0;
-    s->check = 0;
-    s->last = NULL;
-    s->succ = NULL;
-    s->cSucc = 0;
-    s->nSucc = 0;
+static const char* skip_spaces(const char* c) {
+    while (*c == ' ' || *c == '\t')
+        c++;
+    return c;
 }
 
-void autosave_game(const struct State* s) {
-    char gamefn[80];
-    mkdir("history", 0777);
-    snprintf(gamefn, 80, "history/move%d.game", s->ply);
-    save_game(s, gamefn);
+// Whether the King and the corner Rook of one side still have castling rights, on board.
+// side: 0 for the Queenside, 1 for the Kingside.
+static uint8_t can_castle(const uint8_t board[128], uint8_t colour, uint8_t side) {
+    uint8_t home = colour == BLACK ? 0x74 : 0x04;
+    uint8_t king = board[home], rook = board[home + castlingSquares[side]];
+    return ROLE(king) == KING && !IS_PIECE_MOVED(king) && (king & BLACK) == colour
+        && ROLE(rook) == ROOK && !IS_PIECE_MOVED(rook) && (rook & BLACK) == colour;
 }
 
-#ifdef DEBUG
-const struct State* load_debug_state(const char* buf) {
-        const struct State* ds = NULL;
+const char* state_from_fen(struct State* s, const char* fen) {
+    struct State t;
+    memset(&t, 0, sizeof(struct State));
+    const char* c = skip_spaces(fen);
+
+    // Piece placement, from the eighth rank down. Every King and Rook has moved until the rights say otherwise.
+    int rank = 7, file = 0;
+    for (; *c && *c != ' '; c++) {
+        if (*c == '/') {
+            if (file != 8 || rank == 0)
+                return NULL;
+            rank--;
+            file = 0;
+        } else if (*c >= '1' && *c <= '8') {
+            file += *c - '0';
+            if (file > 8)
+                return NULL;
+        } else {
+            const char* sym = memchr(fenSyms + 1, tolower(*c), 6);
+            if (sym == NULL || file >= 8)
+                return NULL;
+            uint8_t role = sym - fenSyms;
+            if (role == PAWN && (rank == 0 || rank == 7))
+                return NULL;
+            uint8_t piece = (islower(*c) ? BLACK : WHITE) | role;
+            if (role == KING || role == ROOK)
+                piece |= PIECE_MOVED;
+            t.board[to_0x88(rank, file)] = piece;
+            file++;
+        }
+    }
+    if (rank != 0 || file != 8)
+        return NULL;
+
+    // Player to move
+    c = skip_spaces(c);
+    if (*c != 'w' && *c != 'b')
+        return NULL;
+    uint8_t black = *c++ == 'b';
+
+    // Castling rights
+    c = skip_spaces(c);
+    if (*c == '-') {
+        c++;
+    } else {
+        for (; *c && *c != ' '; c++) {
+            const char* sym = strchr("QKqk", *c);
+            if (sym == NULL)
+                return NULL;
+            uint8_t colour = sym - "QKqk" >= 2 ? BLACK : WHITE;
+            uint8_t side = (sym - "QKqk") % 2;
+            uint8_t home = colour == BLACK ? 0x74 : 0x04;
+            uint8_t* king = &t.board[home];
+            uint8_t* rook = &t.board[home + castlingSquares[side]];
+            if (ROLE(*king) != KING || (*king & BLACK) != colour || ROLE(*rook) != ROOK || (*rook & BLACK) != colour)
+                return NULL;
+            *king &= ~PIECE_MOVED;
+            *rook &= ~PIECE_MOVED;
+        }
+    }
+
+    // En passant: the pawn that just made a two-step, and that move
+    c = skip_spaces(c);
+    if (*c == '-') {
+        c++;
+    } else {
+        char coord[2] = {c[0], c[0] ? c[1] : 0};
+        uint8_t target = coord_to_0x88(coord);
+        if (target == 0xFF || (target >> 4) != (black ? 2 : 5))
+            return NULL;
+        uint8_t dest = target + (black ? UP : DOWN);
+        uint8_t orig = target + (black ? DOWN : UP);
+        if (t.board[dest] != ((black ? WHITE : BLACK) | PAWN) || !IS_VACANT(t.board[target]) || !IS_VACANT(t.board[orig]))
+            return NULL;
+        t.board[dest] |= PAWN_TWO_STEP | PIECE_MOVED;
+        t.lastMove = (struct Move){.orig = orig, .dest = dest, .role = PAWN, .valid = 1};
+        c += 2;
+    }
+
+    // Halfmove clock and move number, if given
+    long halfmoves = 0, moveNumber = 1;
+    c = skip_spaces(c);
+    if (isdigit(*c)) {
+        halfmoves = strtol(c, (char**)&c, 10);
+        c = skip_spaces(c);
+        if (isdigit(*c))
+            moveNumber = strtol(c, (char**)&c, 10);
+    }
+    t.halfmoveClock = halfmoves < UINT8_MAX ? halfmoves : UINT8_MAX;
+    t.ply = (moveNumber > 1 ? 2 * (moveNumber - 1) : 0) + black;
+
+    // One King each, and the player who just moved cannot be left in check.
+    uint8_t kings[2] = {0, 0};
+    for (uint8_t pos = 0; pos < 128; pos++)
+        if (is_on_board(pos) && ROLE(t.board[pos]) == KING)
+            kings[IS_BLACK(t.board[pos]) ? 1 : 0]++;
+    if (kings[0] != 1 || kings[1] != 1)
+        return NULL;
+    uint8_t mover = black ? BLACK : WHITE;
+    if (is_square_attacked(t.board, find_king(t.board, mover ^ BLACK), mover))
+        return NULL;
 
-        if (strncasecmp(buf, "load perft2", 80) == 0)
-            ds = &perft2;
-        else if (strncasecmp(buf, "load perft3", 80) == 0)
-            ds = &perft3;
-        else if (strncasecmp(buf, "load perft5", 80) == 0)
-            ds = &perft5;
-        else if (strncasecmp(buf, "load promo1", 80) == 0)
-            ds = &promo1;
-        else if (strncasecmp(buf, "load promo2", 80) == 0)
-            ds = &promo2;
-        else if (strncasecmp(buf, "load promo3", 80) == 0)
-            ds = &promo3;
-        else if (strncasecmp(buf, "load promo4", 80) == 0)
-            ds = &promo4;
+    refresh_state(&t);
+    memcpy(s, &t, sizeof(struct State));
+    return c;
+}
 
-        return ds;
+void state_to_fen(const struct State* s, char fen[FEN_LEN]) {
+    char* c = fen;
+    for (int8_t r = 7; r >= 0; r--) {
+        uint8_t empty = 0;
+        for (int8_t f = 0; f <= 7; f++) {
+            uint8_t piece = s->board[to_0x88(r, f)];
+            if (IS_VACANT(piece)) {
+                empty++;
+                continue;
+            }
+            if (empty)
+                *c++ = '0' + empty;
+            empty = 0;
+            *c++ = IS_BLACK(piece) ? fenSyms[ROLE(piece)] : toupper(fenSyms[ROLE(piece)]);
+        }
+        if (empty)
+            *c++ = '0' + empty;
+        if (r)
+            *c++ = '/';
+    }
+    *c++ = ' ';
+    *c++ = BLACK_TO_MOVE(s) ? 'b' : 'w';
+    *c++ = ' ';
+
+    char* rights = c;
+    for (uint8_t i = 0; i < 4; i++) {
+        uint8_t colour = i >= 2 ? BLACK : WHITE;
+        uint8_t side = !(i % 2); // Kingside first
+        if (can_castle(s->board, colour, side))
+            *c++ = "KQkq"[i];
+    }
+    if (c == rights)
+        *c++ = '-';
+    *c++ = ' ';
+
+    const struct Move* last = &s->lastMove;
+    if (last->valid && last->role == PAWN && IS_PAWN_TWO_STEP(s->board[last->dest])) {
+        from_0x88_to_coord((last->orig + last->dest) / 2, c);
+        c += 2;
+    } else {
+        *c++ = '-';
+    }
+    snprintf(c, FEN_LEN - (c - fen), " %d %d", s->halfmoveClock, s->ply / 2 + 1);
 }
-#endif // DEBUG
@@ -20,6 +20,7 @@
 // Bits 3-4: Unused
 
 // Bit 5: For pawns: Whether its first move was a two-step.
+// Only the pawn that made the last move keeps this flag; it is cleared once the opponent replies.
 #define PAWN_TWO_STEP (0x20)
 #define IS_PAWN_TWO_STEP(x) ((x) & PAWN_TWO_STEP)
 
@@ -48,6 +49,10 @@ void from_0x88(uint8_t pos, uint8_t* rank, uint8_t* file);
 uint8_t coord_to_0x88(char coord[2]);
 uint8_t from_0x88_to_coord(uint8_t pos, char coord[2]);
 
+// Conversion between 0x88 and square numbers 0-63 (rank * 8 + file)
+#define TO_SQ64(pos) (((pos) + ((pos) & 0x07)) >> 1)
+#define FROM_SQ64(sq) ((sq) + ((sq) & ~0x07))
+
 // Position relationships
 #define LEFT        (-0x01)
 #define RIGHT       (+0x01)
@@ -62,6 +67,15 @@ uint8_t from_0x88_to_coord(uint8_t pos, char coord[2]);
 // Game states
 // Two states are considered equal if (board) is equal and (ply) is both odd or both even
 // ===========================================================================
+#ifdef BITBOARD
+// The board as bitboards, for the bitboard move generator (see bitboard.h).
+// Bit n is the square (rank n / 8, file n % 8), numbered as by TO_SQ64(), so a1 = 0, h1 = 7, h8 = 63.
+struct Bitboards {
+    uint64_t roles[7];   // Indexed by ROLE(), both colours together.
+    uint64_t colours[2]; // 0: White, 1: Black
+    uint64_t occupied;
+};
+#endif // BITBOARD
 
 // Move notation (in 0x88 notation)
 struct Move {
@@ -70,7 +84,6 @@ struct Move {
     uint8_t valid; // Either a piece was captured or the position is in bounds.
     uint8_t pieceCaptured;
     uint8_t promoRole; // Pawn promotion: What did the player choose? (role only)
-    char algebra[6]; // Algebraic representation
 };
 
 struct State {
@@ -79,53 +92,121 @@ struct State {
     // Current ply (half-move), starting at zero.
     // Even means white to move, Odd means black to move.
     uint8_t ply;
-
-    // Progress of successor state generation.
-    // First we generate everything, except castles.
-    // We then generate Castles separately, as they require is_in_check() to be recursively called.
-    // Finally, we remove the moves that would cause the King to be in Check.
-    uint8_t castlesExpanded, checksRemoved;
-    // Whether the player to move is in check.
-    // Combined with nSucc = 0 means either stalemate (0) or checkmate (1)
-    // Only valid when castlesExpanded is true and is_in_check() is called.
-    uint8_t check;
-    
-    // Previous and next states
+    // Plies since the last capture or pawn move, for the fifty-move rule.
+    uint8_t halfmoveClock;
+    // Zobrist key of the position, updated by make_move(). See zobrist_key().
+    uint64_t key;
+    // Static evaluation in centipawns, from White's point of view, updated by make_move(). See evaluate().
+    int16_t eval;
+#ifdef BITBOARD
+    // The board again, updated by make_move() and unmake_move().
+    struct Bitboards bb;
+#endif // BITBOARD
+
+    // The move that led to this state
     struct Move lastMove;
-    struct State* last;
-    struct State* succ; // Dynamic array
-    uint8_t cSucc, nSucc; // Array capacity and size
-
-    // For MCTS: Number of times each side won
-    uint64_t winsB, winsW, draws;
 };
 
 #define BLACK_TO_MOVE(s) ((s)->ply % 2)
 #define WHITE_TO_MOVE(s) (!BLACK_TO_MOVE((s)))
 
-#define GAMES_PLAYED(s) ((s)->winsB + (s)->winsW + (s)->draws)
-
 void print_state(const struct State* s);
+// Algebraic representation of a move, e.g. "Ng1f3" or "e7e8Q", terminated.
+// Only formatted where a person reads it; the search deals in struct Move alone.
+#define ALGEBRA_LEN (6)
+void move_to_algebra(const struct Move* m, char algebra[ALGEBRA_LEN]);
+
+// Moves packed into 16 bits: origin and destination squares (0-63), and the promotion role.
+uint16_t pack_move(const struct Move* m);
+// Unpacks a move to be played in s.
+void unpack_move(const struct State* s, uint16_t packed, struct Move* m);
+
+// Fills the Zobrist and evaluation tables. Must be called once before any position is hashed or evaluated.
+void board_init(void);
+// Recomputes the fields make_move() keeps up to date (key, eval and bitboards), for positions that did not come from it.
+void refresh_state(struct State* s);
+
+// ===========================================================================
+// Zobrist hashing
+// Equal positions, in the sense above, have equal keys. A key covers the pieces,
+// the player to move, castling rights, and the file a pawn may be taken en passant on.
+// ===========================================================================
+// Computes the key of s from scratch.
+uint64_t zobrist_key(const struct State* s);
+
+// ===========================================================================
+// Static evaluation
+// Material plus piece-square tables, so a change of square adjusts it by a table lookup.
+// ===========================================================================
+// Computes the evaluation of s from scratch.
+int16_t evaluate(const struct State* s);
 
 // ===========================================================================
 // Legal moves
 // ===========================================================================
-// Populates s->succ with successor states as a result of legal moves.
-// Turn off recursion when querying for check.
-void get_legal_moves(struct State* s);
-// Recursively cleans up successor states, ignoring the state dontfree (if not NULL)
-void clean_up_successors(struct State* s, const struct State* dontfree);
+// Upper bound on the number of legal moves in any position.
+#define MAX_MOVES (256)
+
+// Fills out with the legal moves in s and returns how many there are.
+uint8_t generate_moves(const struct State* s, struct Move* out);
+
+// What unmake_move() needs to restore the position: the previous contents of each square written.
+struct Undo {
+    struct Move lastMove;
+    uint64_t key;
+    int16_t eval;
+    uint8_t halfmoveClock;
+    uint8_t n;
+    uint8_t pos[5], piece[5];
+};
+
+// Plays a move from generate_moves() on s in place.
+// Only the position (board, bitboards, ply, halfmoveClock, key, eval and lastMove) is changed.
+void make_move(struct State* s, const struct Move* m, struct Undo* u);
+// Takes back the move that u was filled in for. Moves must be unmade in reverse order.
+void unmake_move(struct State* s, const struct Undo* u);
+
+// Whether the player to move is in check
+uint8_t is_in_check(const struct State* s);
+// Whether any piece of colour byColour (BLACK or WHITE) attacks the square sq.
+// Looks outward from sq, so it costs a handful of board reads rather than a move generation.
+uint8_t is_square_attacked(const uint8_t board[128], uint8_t sq, uint8_t byColour);
+// Position of the King of the given colour, or 0xFF if there is none.
+uint8_t find_king(const uint8_t board[128], uint8_t colour);
 
 // ===========================================================================
-// Saving and Loading
+// Draws by rule
+// Repetitions are found by key, in the history of positions that led to one.
 // ===========================================================================
-void save_game(const struct State* s, const char* gamefn);
-void autosave_game(const struct State* s);
+// Plies without a capture or pawn move before the game is drawn.
+#define FIFTY_MOVE_PLIES (100)
+
+// How many times the position s occurred before, up to two, given the keys of the
+// positions leading to it, oldest first. Only positions since the last capture or pawn move can match.
+uint8_t count_repetitions(const struct State* s, const uint64_t* history, int n);
+// Whether the game is drawn by the fifty-move rule or threefold repetition.
+uint8_t is_draw_by_rule(const struct State* s, const uint64_t* history, int n);
 
-void load_game(struct State* s, const char* gamefn);
-#ifdef DEBUG
-const struct State* load_debug_state(const char* buf);
-#endif // DEBUG
+#if defined(DEBUG) && defined(BITBOARD)
+// Compares the legal moves in s from both move generators.
+uint8_t verify_legal_moves(const struct State* s);
+#endif // DEBUG && BITBOARD
 
+// ===========================================================================
+// Forsyth-Edwards Notation (FEN)
+// Castling rights map onto PIECE_MOVED on the King and Rooks, the en passant square onto
+// PAWN_TWO_STEP and lastMove, and the move number onto ply. ply wraps at 256 keeping its
+// parity, so the move number written back is only exact before move 128.
+// https://www.chessprogramming.org/Forsyth-Edwards_Notation
+// ===========================================================================
+// Longest FEN written, terminated.
+#define FEN_LEN (96)
+
+// Sets s to the position in fen. The halfmove clock and move number may be left out, as in EPD.
+// Returns where parsing stopped (e.g. at EPD operations), or NULL if fen is not a legal position,
+// in which case s is unchanged.
+const char* state_from_fen(struct State* s, const char* fen);
+// Writes the FEN of s, terminated.
+void state_to_fen(const struct State* s, char fen[FEN_LEN]);
 
 #endif // BOARD_H
@@ -0,0 +1,36 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "board.h"
+
+// ===========================================================================
+// Opening book
+// Polyglot .bin books, mapped into memory and searched by key: 16-byte big-endian entries of
+// key, move, weight and learning data, sorted by key. http://hgm.nubati.net/book_format.html
+// The keys use Polyglot's own table of 781 random numbers, built in, and are checked against
+// those the format's documentation gives for a few positions before a book is first used.
+// ===========================================================================
+#define BOOK_RANDOM_LEN (781)
+
+struct Book {
+    const uint8_t* entries;
+    uint64_t n;
+    size_t bytes; // Of the mapping
+    uint64_t rng; // For the choice between book moves
+};
+
+// Maps the book at path. Returns 0, with a warning, if it cannot be used.
+uint8_t book_open(struct Book* b, const char* path);
+void book_close(struct Book* b);
+
+// The Polyglot key of s.
+uint64_t book_key(const struct State* s);
+
+// Picks one of the book's moves for s at random, in proportion to their weights, and sets m to it.
+// Returns 0 if the book has no legal move for s. *weight and *total are its weight and that of all of them.
+uint8_t book_probe(struct Book* b, const struct State* s, struct Move* m, uint16_t* weight, uint32_t* total);
+
+#endif // BOOK_H
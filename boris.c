@@ -1,3 +1,4 @@
+#include <errno.h>
 #include <math.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -8,7 +9,20 @@
 #include <pthread.h>
 #include <unistd.h>
 
+#include "batch.h"
 #include "board.h"
+#include "book.h"
+#include "journal.h"
+#include "perft.h"
+#include "playout.h"
+#include "pool.h"
+#include "search.h"
+#include "trace.h"
+#include "tree.h"
+#include "uci.h"
+#ifdef BITBOARD
+#include "bitboard.h"
+#endif // BITBOARD
 
 // Initial game state
 extern const struct State initialState;
@@ -16,283 +30,217 @@ extern const struct State initialState;
 // ===========================================================================
 // Multithreading
 // ===========================================================================
-// Representation of a worker thread
-struct Worker {
-    // Buffer for RNG used by random_r()
-    char rngstatebuf[256];
-    struct random_data rng;
-    // File descriptors where states are accepted for simulation and the return of results.
-    int fdin[2], fdout[2];
-    pthread_t thr;
+// A search handed to every worker: each runs whole iterations on the shared tree until it is stopped.
+struct Job {
+    struct Tree* t;
+    volatile int* searching;
+    struct PlayoutLimits limits;
 };
 
 int nthreads;
 struct Worker* workers;
-
-// ===========================================================================
-
-#ifdef DEBUG
-static uint64_t count_succ_recurse(struct State* s, int depth, uint8_t root) {
-    get_legal_moves(s);
-
-    if (depth == 0)
-        return s->nSucc;
-
-    uint64_t total = 0;
-    for (uint8_t i = 0; i < s->nSucc; i++) {
-        uint64_t nSucc = count_succ_recurse(&s->succ[i], depth - 1, 0);
-        if (root) {
-            printf("%s: %ld\n", s->succ[i].lastMove.algebra, nSucc);
-        }
-        total += nSucc;
-        clean_up_successors(&s->succ[i], NULL); // Free memory as we go
-    }
-    return total;
+struct Pool pool;
+
+// Pool task: search until stopped.
+static void search_task(void* args) {
+    struct Job* job = (struct Job*)args;
+    struct Worker* w = &workers[pool_worker_index()];
+    while (*job->searching)
+        mcts_iter(job->t, &job->limits, w);
 }
-#endif // DEBUG
 
-// Adjusted to the player to move in s0, where s is a descendant state.
-// Using Upper-Confidence Bound for Trees.
-static double ucb_s(const struct State* s0, const struct State* s) {
-    int64_t wins = BLACK_TO_MOVE(s0) ? s->winsB : s->winsW;
-    int64_t losses = BLACK_TO_MOVE(s0) ? s->winsW : s->winsB;
-    double exploit = (double)(wins - losses) / (double)GAMES_PLAYED(s);
-    double c = 0.5;
-    double explore = c * (sqrt(log(GAMES_PLAYED(s->last)) / GAMES_PLAYED(s)));
-    double ucb = exploit + explore;
-    return ucb;
+static double seconds_between(const struct timespec* start, const struct timespec* end) {
+    return (end->tv_sec - start->tv_sec) + (end->tv_nsec - start->tv_nsec) / 1e9;
 }
 
-// Returns a descendant state that has yet to be played out.
-// If all successors of a state have been played out, recurse.
-static struct State* selection(struct State* s0, struct State* s) {
-    // Ensure all successors have been simulated
-    get_legal_moves(s);
-    if (s->nSucc == 0) {
-        // End of a game.
-        return s;
-    }
-
-    // Pick a successor to recurse.
-    // Whatever move has the best advantage for the person to play.
-    struct State* selected = NULL;
-    double umax = -INFINITY;
-
-    for (uint8_t i = 0; i < s->nSucc; i++) {
-        if (GAMES_PLAYED(&s->succ[i]) == 0) {
-            // Base case: Not simulated yet.
-            return &s->succ[i];
-        }
-        double ucb = ucb_s(s0, &s->succ[i]) ;
-        if (ucb > umax) {
-            selected = &s->succ[i];
-            umax = ucb;
-        }
-    }
-    return selection(s0, selected);
-}
+// Writes the search counters as JSON to stderr at an interval, while a search runs.
+struct Reporter {
+    struct Tree* t;
+    volatile int* searching;
+    const struct timespec* searchStart;
+    int intervalMs; // Zero to stop
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // Stop requested
+};
 
-// Make random moves until someone wins.
-static void playout(struct State* s0, struct random_data* rng) {
-    struct State* s = s0;
-    uint8_t finished = 0;
-
-    for (int i = 0; i < 200; i++) {
-        get_legal_moves(s);
-        if (s->nSucc == 0) {
-            // The game has finished. Proprogate game result.
-            if (s->check) {
-                // Checkmate
-                if (BLACK_TO_MOVE(s)) {
-                    s0->winsW++;
-                } else {
-                    s0->winsB++;
-                }
-            } else {
-                // Stalemate
-                s0->draws++;
-            }
-            finished = 1;
-            break;
-        } else {
-            int32_t temp;
-            random_r(rng, &temp); // 'Cause multithreading
-            struct State* succ = &s->succ[temp % s->nSucc];
-            s = succ;
+static void* report_stats(void* args) {
+    struct Reporter* r = (struct Reporter*)args;
+    pthread_mutex_lock(&r->lock);
+    while (r->intervalMs) {
+        struct timespec wakeAt;
+        clock_gettime(CLOCK_MONOTONIC, &wakeAt);
+        wakeAt.tv_sec += r->intervalMs / 1000;
+        wakeAt.tv_nsec += (r->intervalMs % 1000) * 1000000L;
+        if (wakeAt.tv_nsec >= 1000000000L) {
+            wakeAt.tv_sec++;
+            wakeAt.tv_nsec -= 1000000000L;
         }
+        if (pthread_cond_timedwait(&r->wake, &r->lock, &wakeAt) != ETIMEDOUT || !*r->searching)
+            continue;
+        pthread_mutex_unlock(&r->lock);
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        stats_report(stderr, 1, r->t, workers, nthreads, &pool, seconds_between(r->searchStart, &now));
+        pthread_mutex_lock(&r->lock);
     }
-    // The game didn't finish within the move limit.
-    if (!finished) {
-        s0->draws++;
-    }
-
-    clean_up_successors(s0, NULL);
-}
-
-static void* accept_playouts(void* args) {
-    struct Worker* w = (struct Worker*)args;
-    for (;;) {
-        struct State* s0;
-        int err;
-        err = read(w->fdin[0], &s0, sizeof(struct State*));
-        if (err < 0) warn("read(): Cannot read pipe in worker thread");
-
-        if (s0 == NULL)
-            // Terminate thread
-            break;
-        playout(s0, &w->rng);
-
-        err = write(w->fdout[1], &s0, sizeof(struct State*));
-        if (err < 0) warn("write(): Cannot write pipe in worker thread");
-    }
+    pthread_mutex_unlock(&r->lock);
     return NULL;
 }
 
-static void mcts_iter(struct State* s) {
-    // SELECTION: Using upper-confidence bound
-    struct State* selected = selection(s, s);
-
-    // SIMULATION
-    // Multithreaded playout, with time limit
-    struct State* instance = malloc(nthreads * sizeof(struct State));
-    int err;
-    for (int t = 0; t < nthreads; t++) {
-        // Hopefully this will prevent us from trashing memory
-        memcpy(&instance[t], selected, sizeof(struct State));
-        instance[t].last = NULL;
-        instance[t].succ = NULL;
-        instance[t].cSucc = 0;
-        instance[t].nSucc = 0;
-        instance[t].winsB = 0;
-        instance[t].winsW = 0;
-        instance[t].draws = 0;
-        struct State* instaddr = &instance[t];
-        err = write(workers[t].fdin[1], &instaddr, sizeof(struct State*));
-        if (err < 0) warn("write(): Cannot write in pipe to worker thread");
-    }
-    // Collect results
-    for (int t = 0; t < nthreads; t++) {
-        struct State* dummy;
-        err = read(workers[t].fdout[0], &dummy, sizeof(struct State*));
-        if (err < 0) warn("read(): Cannot read from pipe to worker thread");
-        selected->winsB += instance[t].winsB;
-        selected->winsW += instance[t].winsW;
-        selected->draws += instance[t].draws;
-    }
-    free(instance);
-
-    // BACKPROPROGATION
-    struct State* cur = selected;
-    for (;;) {
-        cur = cur->last;
-        cur->winsB += selected->winsB;
-        cur->winsW += selected->winsW;
-        cur->draws += selected->draws;
-        if (cur == s)
-            break;
-    }
-}
-
-struct MCTS_args {
-    struct State* s;
-    int* searching;
-};
-
-static void* mcts(void* args) {
-    struct State* s = ((struct MCTS_args*)args)->s;
-    int* searching = ((struct MCTS_args*)args)->searching;
-    
-    while (*searching)
-        mcts_iter(s);
-
-    return NULL;
+// Stops the reporter, if running, without waiting out its interval.
+static void stop_reporter(struct Reporter* r) {
+    pthread_mutex_lock(&r->lock);
+    uint8_t running = r->intervalMs != 0;
+    r->intervalMs = 0;
+    pthread_cond_signal(&r->wake);
+    pthread_mutex_unlock(&r->lock);
+    if (running)
+        pthread_join(r->thread, NULL);
 }
 
-int main() {
-    struct State s;
-    memcpy(&s, &initialState, sizeof(struct State));
+int main(int argc, char** argv) {
+    board_init();
+    TRACE_INIT();
+#ifdef BITBOARD
+    bb_init();
+#endif // BITBOARD
+
+    // Non-interactive modes
+    if (argc >= 2 && strcasecmp(argv[1], "perft") == 0)
+        return perft_main(argc - 2, argv + 2);
+    if (argc >= 2 && strcasecmp(argv[1], "batch") == 0)
+        return batch_main(argc - 2, argv + 2);
+    if (argc >= 2 && strcasecmp(argv[1], "uci") == 0)
+        return uci_main();
+
+    // The game position is the root of the search tree: the initial one, `boris fen <FEN>`,
+    // or where the game in `boris resume <journal>` left off. Each move played is journalled.
+    struct State start;
+    memcpy(&start, &initialState, sizeof(struct State));
+    if (argc >= 3 && strcasecmp(argv[1], "fen") == 0 && state_from_fen(&start, argv[2]) == NULL)
+        errx(1, "Not a legal position in FEN: %s", argv[2]);
+    struct Journal journal;
+    uint64_t keys[FIFTY_MOVE_PLIES];
+    int nKeys = 0;
+    if (argc >= 3 && strcasecmp(argv[1], "resume") == 0) {
+        if (journal_resume(&journal, argv[2], &start, keys, &nKeys) < 0)
+            errx(1, "Cannot resume the game in %s", argv[2]);
+    } else {
+        journal_start(&journal, &start);
+    }
+    struct Book book = {.entries = NULL};
+    struct Tree tree;
+    tree_init(&tree, &start);
+    tree_set_history(&tree, keys, nKeys);
+    struct State* s = &tree.root;
 
     // Set up MCTS playout threads
-    int searchRunning = 0;
-    nthreads = 12; // Ask user TODO
+    volatile int searchRunning = 0;
+    struct Job search = {.t = &tree, .searching = &searchRunning, .limits = {0, 0}};
+    struct PoolGroup searchGroup = {0};
+    struct timespec searchStart, searchStop;
+    clock_gettime(CLOCK_MONOTONIC, &searchStart);
+    searchStop = searchStart;
+    struct Reporter reporter = {.t = &tree, .searching = &searchRunning, .searchStart = &searchStart, .intervalMs = 0};
+    // Its intervals are on the monotonic clock.
+    pthread_mutex_init(&reporter.lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&reporter.wake, &attr);
+    pthread_condattr_destroy(&attr);
+    nthreads = sysconf(_SC_NPROCESSORS_ONLN); // One per core
+    if (nthreads < 1)
+        nthreads = 1;
     workers = malloc(nthreads * sizeof(struct Worker));
     for (int t = 0; t < nthreads; t++) {
-        // Set up pipes and seed RNG for each thread
-        int err;
-        err = pipe(workers[t].fdin);
-        if (err < 0) warn("pipe(): Cannot create pipe to worker thread");
-        err = pipe(workers[t].fdout);
-        if (err < 0) warn("pipe(): Cannot create pipe to worker thread");
-        workers[t].rng.state = NULL;
-        err = initstate_r(time(NULL) + (t * 7), workers[t].rngstatebuf, 256, &workers[t].rng);
-        if (err < 0) warn("srandom_r(): Cannot seed rng for worker thread");
-
-        pthread_create(&workers[t].thr, NULL, accept_playouts, &workers[t]);
+        // Seed RNG for each thread
+        workers[t].rng = playout_seed(time(NULL) + (t * 7));
     }
+    pool_init(&pool, nthreads);
 
     // Prompt loop
     for (;;) {
-        print_state(&s);
-        get_legal_moves(&s);
+        print_state(s);
+        struct Children* root = tree_expand(&tree, tree.rootNode, s);
+        uint8_t check = is_in_check(s);
 
         // Stalemate? Checkmate?
-        if (s.nSucc == 0) {
-            if (s.check)
+        if (root->n == 0) {
+            if (check)
                 printf("CHECKMATE\n");
             else
                 printf("STALEMATE\n");
             break;
         }
 
+        if (s->halfmoveClock >= FIFTY_MOVE_PLIES) {
+            printf("DRAW BY THE FIFTY-MOVE RULE\n");
+            break;
+        }
+        if (count_repetitions(s, tree.history, tree.historyLen) >= 2) {
+            printf("DRAW BY THREEFOLD REPETITION\n");
+            break;
+        }
+
         // Check?
-        if (s.check)
+        if (check)
             printf("CHECK\n");
         
         // Print legal moves with advantages for current player
-        struct State* best = NULL;
+        char algebra[MAX_MOVES][ALGEBRA_LEN];
+        int best = -1;
         double bestAdv = -INFINITY;
-        for (uint8_t i = 0; i < s.nSucc; i++) {
+        for (uint8_t i = 0; i < root->n; i++) {
             if (i % 4 == 0)
                 printf("\n");
-            int64_t wins = BLACK_TO_MOVE(&s) ? s.succ[i].winsB : s.succ[i].winsW;
-            int64_t losses = BLACK_TO_MOVE(&s) ? s.succ[i].winsW : s.succ[i].winsB;
-            double advantage = (double)(wins - losses) / (double)GAMES_PLAYED(&s.succ[i]);
+            struct Move m;
+            unpack_move(s, root->move[i], &m);
+            move_to_algebra(&m, algebra[i]);
+            struct MoveStats ms;
+            root_move_stats(&tree, i, &ms);
             char moveAdv[80];
-            snprintf(moveAdv, 80, "%-5s: %- 6.3f (%ld %ld %ld)", s.succ[i].lastMove.algebra,
-                    advantage, wins, losses, s.succ[i].draws);
+            snprintf(moveAdv, 80, "%-5s: %- 6.3f (%u %u %ld)", algebra[i],
+                    ms.advantage, ms.wins, ms.losses, (int64_t)ms.visits - ms.wins - ms.losses);
             printf("%-35s", moveAdv);
-            if (best == NULL || (advantage > bestAdv)) {
-                best = &s.succ[i];
-                bestAdv = advantage;
+            if (best < 0 || (ms.advantage > bestAdv)) {
+                best = i;
+                bestAdv = ms.advantage;
             }
         }
-        printf("\nMove with best advantage: %s (%.3f)\n", best->lastMove.algebra, bestAdv);
+        printf("\nMove with best advantage: %s (%.3f)\n", algebra[best], bestAdv);
 
         // PROMPT user
         uint8_t cmdValid = 0;
-        char buf[80];
-        bzero(buf, 80);
+        char buf[128]; // Room for a FEN
+        bzero(buf, sizeof(buf));
         printf("\n\n");
         if (!searchRunning) {
-            printf("Please enter a move, or type \"search\"");
+            printf("Please enter a move, or type \"search\" or \"play\"");
         } else {
             printf("Type \"stop\" before entering a move");
         }
         printf(" > ");
         fflush(stdout);
-        char* e = fgets(buf, 80, stdin);
+        char* e = fgets(buf, sizeof(buf), stdin);
         if (e == NULL)
             break; // Error or end of input
-        size_t z = strnlen(buf, 80);
+        size_t z = strnlen(buf, sizeof(buf));
         buf[z - 1] = 0; // Strip trailing newline
 
         // Perform MCTS
-        pthread_t mctsThread;
         if (strncasecmp(buf, "search", 80) == 0) {
             if (!searchRunning) {
+                tree_prune(&tree);
+                stats_reset(workers, nthreads, &pool);
+                clock_gettime(CLOCK_MONOTONIC, &searchStart);
                 searchRunning = 1;
-                struct MCTS_args args = {.s = &s, .searching = &searchRunning};
-                pthread_create(&mctsThread, NULL, mcts, (void*)&args);
+                // One task per worker, each searching until stopped.
+                void* args[nthreads];
+                for (int w = 0; w < nthreads; w++)
+                    args[w] = &search;
+                pool_submit(&pool, search_task, args, nthreads, &searchGroup);
                 cmdValid = 1;
             } else {
                 printf("The search is already running.\n");
@@ -300,60 +248,174 @@ int main() {
         } else if (strncasecmp(buf, "stop", 80) == 0) {
             if (searchRunning) {
                 searchRunning = 0;
-                pthread_join(mctsThread, NULL);
-                printf("Finished simulating %ld games.\n", GAMES_PLAYED(&s));
+                pool_wait(&pool, &searchGroup);
+                clock_gettime(CLOCK_MONOTONIC, &searchStop);
+                double seconds = seconds_between(&searchStart, &searchStop);
+                uint64_t playouts = 0, plies = 0;
+                for (int w = 0; w < nthreads; w++) {
+                    playouts += workers[w].stats.playouts;
+                    plies += workers[w].stats.plies;
+                }
+                printf("Finished simulating %d games.\n", tree.rootNode->visits);
+                printf("%ld playouts in %.2f s: %.0f playouts/sec, %.1f plies/playout\n", playouts, seconds,
+                        playouts / seconds, playouts ? (double)plies / playouts : 0.0);
                 cmdValid = 1;
             } else {
                 printf("A search is not running.\n");
             }
         }
         
+        // Search counters: now, or as JSON on stderr every so many milliseconds (0 to stop)
+        int intervalMs;
+        if (strncasecmp(buf, "stats", 80) == 0) {
+            struct timespec now;
+            clock_gettime(CLOCK_MONOTONIC, &now);
+            stats_report(stdout, 0, &tree, workers, nthreads, &pool,
+                    seconds_between(&searchStart, searchRunning ? &now : &searchStop));
+            cmdValid = 1;
+        } else if (sscanf(buf, "stats every %d", &intervalMs) == 1 && intervalMs >= 0) {
+            stop_reporter(&reporter);
+            reporter.intervalMs = intervalMs;
+            if (intervalMs && pthread_create(&reporter.thread, NULL, report_stats, &reporter) != 0)
+                err(1, "pthread_create(): Cannot start the statistics reporter");
+            cmdValid = 1;
+        }
+
+        // Trace of the events recorded so far, for chrome://tracing
+        if (strncasecmp(buf, "trace ", 6) == 0) {
+#ifdef TRACE
+            if (trace_dump(buf + 6))
+                cmdValid = 1;
+#else
+            printf("Tracing is not compiled in; build with `make TRACE=1`.\n");
+#endif // TRACE
+        }
+
+        // Statistics to start positions from, wherever the game reaches them: saved from the tree, or loaded
+        if (strncasecmp(buf, "tree save ", 10) == 0 || strncasecmp(buf, "tree load ", 10) == 0) {
+            if (searchRunning)
+                printf("Please stop the search first.\n");
+            else if (buf[5] == 's' || buf[5] == 'S')
+                cmdValid = tree_save(&tree, buf + 10, TREE_SAVE_DEPTH);
+            else
+                cmdValid = tree_seed(&tree, buf + 10);
+        }
+
+        // Polyglot opening book for "play": `book <file>`
+        char bookPath[64];
+        if (sscanf(buf, "book %63s", bookPath) == 1) {
+            book_close(&book);
+            cmdValid = book_open(&book, bookPath);
+        }
+
+        // Memory limit on the tree in MiB, 0 for none. The tree is pruned back under it when a search starts.
+        int mib;
+        if (sscanf(buf, "memory %d", &mib) == 1) {
+            if (searchRunning) {
+                printf("Please stop the search first.\n");
+            } else if (mib < 0) {
+                printf("Usage: memory <MiB, 0 for no limit>\n");
+            } else {
+                tree_set_limit(&tree, (size_t)mib << 20);
+                cmdValid = 1;
+            }
+        }
+
+        // Playout length: plies before scoring from the evaluation, and the swing that ends it early
+        int maxPlies, swing;
+        if (sscanf(buf, "playout %d %d", &maxPlies, &swing) == 2) {
+            if (searchRunning) {
+                printf("Please stop the search first.\n");
+            } else if (maxPlies < 0 || maxPlies > PLAYOUT_MAX_PLIES || swing < 0 || swing > INT16_MAX) {
+                printf("Usage: playout <plies up to %d, 0 for whole games> <evaluation swing in centipawns, 0 for none>\n",
+                        PLAYOUT_MAX_PLIES);
+            } else {
+                search.limits.maxPlies = maxPlies;
+                search.limits.swing = swing;
+                cmdValid = 1;
+            }
+        }
+
         // Makes a move
         // Check that the move is legal, the execute it
-        for (uint8_t i = 0; i < s.nSucc; i++) {
-            if (strncasecmp(buf, s.succ[i].lastMove.algebra, 6) == 0) {
-                if (!searchRunning) {
-                    // Overwrite current state and save it.
-                    struct State succ;
-                    memcpy(&succ, &s.succ[i], sizeof(struct State));
-                    clean_up_successors(&s, &s.succ[i]);
-                    memcpy(&s, &succ, sizeof(struct State));
-
-                    // FIXME Clearing successors at every move should not be necessary.
-                    // But something is trashing successor state representations.
-                    clean_up_successors(&s, NULL);
-
-                    autosave_game(&s);
-                    cmdValid = 1;
+        int played = -1;
+        if (strncasecmp(buf, "play", 80) == 0) {
+            // The engine's choice: from the book, if it has the position, otherwise from the search.
+            // Not while a search is running, as the move is refused below.
+            played = best;
+            struct Move bm;
+            uint16_t weight;
+            uint32_t total;
+            if (!searchRunning && book_probe(&book, s, &bm, &weight, &total)) {
+                for (uint8_t i = 0; i < root->n; i++) {
+                    if (root->move[i] == pack_move(&bm))
+                        played = i;
+                }
+                printf("Book move %s (%u of %u)\n", algebra[played], weight, total);
+            }
+        } else {
+            for (uint8_t i = 0; i < root->n; i++) {
+                if (strncasecmp(buf, algebra[i], ALGEBRA_LEN) == 0) {
+                    played = i;
                     break;
-                } else {
-                    printf("Please stop the search first.\n");
                 }
             }
         }
+        if (played >= 0) {
+            if (!searchRunning) {
+                // The search below the chosen move carries over to the next one.
+                // So is what was learnt here, for "tree save".
+                uint16_t move = root->move[played];
+                tree_keep(&tree, TREE_SAVE_DEPTH);
+                tree_advance(&tree, played);
+                journal_move(&journal, move, s);
+                cmdValid = 1;
+            } else {
+                printf("Please stop the search first.\n");
+            }
+        }
 
-        // TODO
-        // Manual game save
-        // Manual game load
+        // Print the position as FEN, or set up the one given
+        if (strncasecmp(buf, "fen", 80) == 0) {
+            char fen[FEN_LEN];
+            state_to_fen(s, fen);
+            printf("%s\n", fen);
+            cmdValid = 1;
+        } else if (strncasecmp(buf, "fen ", 4) == 0) {
+            struct State fs;
+            if (searchRunning) {
+                printf("Please stop the search first.\n");
+            } else if (state_from_fen(&fs, buf + 4) == NULL) {
+                printf("Not a legal position in FEN.\n");
+            } else {
+                tree_reset(&tree, &fs);
+                journal_close(&journal);
+                journal_start(&journal, s);
+                cmdValid = 1;
+            }
+        }
 
 #ifdef DEBUG
-        // Load debug state
-        const struct State* ds = load_debug_state(buf);
-
-        if (ds) {
-            clean_up_successors(&s, NULL);
-            memcpy(&s, ds, sizeof(struct State));
-            cmdValid = 1;
+        // Load one of the perft positions
+        if (strncasecmp(buf, "load ", 5) == 0) {
+            const struct State* ds = perft_position(buf + 5);
+            if (ds && !searchRunning) {
+                tree_reset(&tree, ds);
+                journal_close(&journal);
+                journal_start(&journal, s);
+                cmdValid = 1;
+            }
         }
 
         // Get state tree size to specified depth
         int depth;
         int nparam = sscanf(buf, "perft %d", &depth);
-        if (nparam == 1) {
-            time_t start = time(NULL);
-            printf("Number of successors (recursive): %ld\n", count_succ_recurse(&s, depth - 1, 1));
-            time_t finish = time(NULL);
-            printf("Time taken: %ld seconds\n", finish - start);
+        if (nparam == 1 && !searchRunning) {
+            struct timespec start, finish;
+            clock_gettime(CLOCK_MONOTONIC, &start);
+            printf("Number of successors (recursive): %ld\n", perft_divide(s, depth));
+            clock_gettime(CLOCK_MONOTONIC, &finish);
+            printf("Time taken: %.9f seconds\n", (finish.tv_sec - start.tv_sec) + (finish.tv_nsec - start.tv_nsec) / 1e9);
             cmdValid = 1;
         }
 #endif // DEBUG
@@ -365,14 +427,18 @@ int main() {
     }
 
     // Terminate threads
-    for (int t = 0; t < nthreads; t++) {
-        struct State* terminate = NULL;
-        int err = write(workers[t].fdin[1], &terminate, sizeof(struct State*));
-        if (err < 0) warn("write(): Cannot write in pipe to worker thread");
-        pthread_join(workers[t].thr, NULL);
+    stop_reporter(&reporter);
+    pthread_mutex_destroy(&reporter.lock);
+    pthread_cond_destroy(&reporter.wake);
+    if (searchRunning) {
+        searchRunning = 0;
+        pool_wait(&pool, &searchGroup);
     }
+    pool_destroy(&pool);
     free(workers);
-    clean_up_successors(&s, NULL);
+    tree_destroy(&tree);
+    journal_close(&journal);
+    book_close(&book);
 
     return 0;
 }
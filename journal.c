@@ -0,0 +1,285 @@
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "journal.h"
+
+#define MAGIC "BORISJNL"
+#define MAGIC_LEN (8)
+#define HEADER_LEN (MAGIC_LEN + 2)
+#define SNAPSHOT_FLAG (0x8000)
+
+// Journals this process has started, to tell apart games started within the same second
+static int gamesStarted;
+
+// ===========================================================================
+// Writing
+// ===========================================================================
+static void append(struct Journal* j, const uint8_t* bytes, size_t n) {
+    pthread_mutex_lock(&j->lock);
+    if (j->pendingLen + n > j->pendingSize) {
+        j->pendingSize = 2 * (j->pendingLen + n);
+        j->pending = realloc(j->pending, j->pendingSize);
+        if (j->pending == NULL)
+            err(1, "realloc(): Cannot buffer game journal");
+    }
+    memcpy(j->pending + j->pendingLen, bytes, n);
+    j->pendingLen += n;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+}
+
+static void append_u16(struct Journal* j, uint16_t v) {
+    uint8_t bytes[2] = {v & 0xFF, v >> 8};
+    append(j, bytes, 2);
+}
+
+static void append_snapshot(struct Journal* j, const struct State* s) {
+    char fen[FEN_LEN];
+    state_to_fen(s, fen);
+    size_t len = strlen(fen);
+    append_u16(j, SNAPSHOT_FLAG | len);
+    append(j, (const uint8_t*)fen, len);
+    j->sinceSnapshot = 0;
+}
+
+static void write_all(int fd, const uint8_t* bytes, size_t n, const char* path) {
+    while (n > 0) {
+        ssize_t written = write(fd, bytes, n);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            warn("write(): Cannot write game journal %s", path);
+            return;
+        }
+        bytes += written;
+        n -= written;
+    }
+}
+
+// Writes whatever is appended, as it comes. Each batch is synced within JOURNAL_SYNC_MS of its first write.
+static void* journal_writer(void* arg) {
+    struct Journal* j = arg;
+    int fd;
+    if (j->create) {
+        mkdir(JOURNAL_DIR, 0777);
+        fd = open(j->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    } else {
+        fd = open(j->path, O_WRONLY | O_APPEND);
+    }
+    if (fd < 0)
+        warn("open(): Cannot open game journal %s", j->path);
+
+    uint8_t dirty = 0;
+    struct timespec syncDue;
+    pthread_mutex_lock(&j->lock);
+    for (;;) {
+        if (j->pendingLen == 0 && !j->closing) {
+            if (!dirty) {
+                pthread_cond_wait(&j->wake, &j->lock);
+            } else if (pthread_cond_timedwait(&j->wake, &j->lock, &syncDue) == ETIMEDOUT) {
+                pthread_mutex_unlock(&j->lock);
+                if (fd >= 0)
+                    fsync(fd);
+                dirty = 0;
+                pthread_mutex_lock(&j->lock);
+            }
+            continue;
+        }
+
+        // Swap buffers, then write without holding up the game.
+        uint8_t* bytes = j->pending;
+        size_t n = j->pendingLen, size = j->pendingSize;
+        j->pending = j->spare;
+        j->pendingSize = j->spareSize;
+        j->pendingLen = 0;
+        uint8_t closing = j->closing;
+        pthread_mutex_unlock(&j->lock);
+
+        if (fd >= 0)
+            write_all(fd, bytes, n, j->path);
+        if (!dirty) {
+            dirty = 1;
+            clock_gettime(CLOCK_MONOTONIC, &syncDue);
+            syncDue.tv_nsec += JOURNAL_SYNC_MS % 1000 * 1000000L;
+            syncDue.tv_sec += JOURNAL_SYNC_MS / 1000 + syncDue.tv_nsec / 1000000000L;
+            syncDue.tv_nsec %= 1000000000L;
+        }
+
+        pthread_mutex_lock(&j->lock);
+        j->spare = bytes;
+        j->spareSize = size;
+        if (closing && j->pendingLen == 0)
+            break;
+    }
+    pthread_mutex_unlock(&j->lock);
+
+    if (fd >= 0) {
+        fsync(fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static void start_writer(struct Journal* j) {
+    j->pending = j->spare = NULL;
+    j->pendingLen = j->pendingSize = j->spareSize = 0;
+    j->closing = 0;
+    pthread_mutex_init(&j->lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&j->wake, &attr);
+    pthread_condattr_destroy(&attr);
+    if (pthread_create(&j->writer, NULL, journal_writer, j) != 0)
+        err(1, "pthread_create(): Cannot start the game journal writer");
+}
+
+void journal_start(struct Journal* j, const struct State* start) {
+    char stamp[32];
+    time_t now = time(NULL);
+    strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", localtime(&now));
+    snprintf(j->path, JOURNAL_PATH_LEN, "%s/%s-%d-%d.journal", JOURNAL_DIR, stamp, (int)getpid(), ++gamesStarted);
+    j->create = 1;
+    start_writer(j);
+
+    uint8_t header[HEADER_LEN];
+    memcpy(header, MAGIC, MAGIC_LEN);
+    header[MAGIC_LEN] = JOURNAL_VERSION & 0xFF;
+    header[MAGIC_LEN + 1] = JOURNAL_VERSION >> 8;
+    append(j, header, HEADER_LEN);
+    append_snapshot(j, start);
+}
+
+void journal_move(struct Journal* j, uint16_t move, const struct State* after) {
+    append_u16(j, move);
+    if (++j->sinceSnapshot == JOURNAL_SNAPSHOT_PLIES)
+        append_snapshot(j, after);
+}
+
+void journal_close(struct Journal* j) {
+    pthread_mutex_lock(&j->lock);
+    j->closing = 1;
+    pthread_cond_signal(&j->wake);
+    pthread_mutex_unlock(&j->lock);
+    pthread_join(j->writer, NULL);
+    pthread_mutex_destroy(&j->lock);
+    pthread_cond_destroy(&j->wake);
+    free(j->pending);
+    free(j->spare);
+}
+
+// ===========================================================================
+// Reading
+// ===========================================================================
+static uint8_t is_legal(const struct State* s, uint16_t move) {
+    struct Move moves[MAX_MOVES];
+    uint8_t n = generate_moves(s, moves);
+    for (uint8_t i = 0; i < n; i++) {
+        if (pack_move(&moves[i]) == move)
+            return 1;
+    }
+    return 0;
+}
+
+// Reads the file with mmap. *length is set to the bytes up to the end of the last good record.
+static int replay(const char* path, struct State* s, uint64_t keys[FIFTY_MOVE_PLIES], int* nKeys, size_t* length) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        warn("open(): Cannot read game journal %s", path);
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || st.st_size < HEADER_LEN) {
+        warnx("%s: Not a game journal", path);
+        close(fd);
+        return -1;
+    }
+    const uint8_t* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        warn("mmap(): Cannot read game journal %s", path);
+        return -1;
+    }
+    if (memcmp(data, MAGIC, MAGIC_LEN) != 0 || (data[MAGIC_LEN] | data[MAGIC_LEN + 1] << 8) != JOURNAL_VERSION) {
+        warnx("%s: Not a game journal, or of another version", path);
+        munmap((void*)data, st.st_size);
+        return -1;
+    }
+
+    int moves = 0;
+    uint8_t started = 0;
+    *nKeys = 0;
+    *length = HEADER_LEN;
+    for (const uint8_t *c = data + HEADER_LEN, *end = data + st.st_size; end - c >= 2; *length = c - data) {
+        uint16_t record = c[0] | c[1] << 8;
+        c += 2;
+        if (record & SNAPSHOT_FLAG) {
+            size_t len = record & ~SNAPSHOT_FLAG;
+            char fen[FEN_LEN];
+            struct State snapshot;
+            if (len >= FEN_LEN || (size_t)(end - c) < len)
+                break;
+            memcpy(fen, c, len);
+            fen[len] = 0;
+            c += len;
+            if (state_from_fen(&snapshot, fen) == NULL) {
+                warnx("%s: Illegal position after move %d", path, moves);
+                break;
+            }
+            // The moves should have led here; if not, believe the snapshot.
+            if (started && snapshot.key != s->key) {
+                warnx("%s: Moves do not lead to the position after move %d", path, moves);
+                *nKeys = 0;
+            }
+            if (!started || snapshot.key != s->key)
+                memcpy(s, &snapshot, sizeof(struct State));
+            started = 1;
+            continue;
+        }
+
+        if (!started || !is_legal(s, record)) {
+            warnx("%s: Illegal move after move %d", path, moves);
+            break;
+        }
+        struct Move m;
+        struct Undo u;
+        unpack_move(s, record, &m);
+        if (*nKeys == FIFTY_MOVE_PLIES) {
+            // Too old to repeat
+            memmove(keys, keys + 1, (FIFTY_MOVE_PLIES - 1) * sizeof(uint64_t));
+            (*nKeys)--;
+        }
+        keys[(*nKeys)++] = s->key;
+        make_move(s, &m, &u);
+        moves++;
+    }
+    munmap((void*)data, st.st_size);
+    if (!started) {
+        warnx("%s: No starting position", path);
+        return -1;
+    }
+    return moves;
+}
+
+int journal_resume(struct Journal* j, const char* path, struct State* s, uint64_t keys[FIFTY_MOVE_PLIES], int* nKeys) {
+    size_t length;
+    int moves = replay(path, s, keys, nKeys, &length);
+    if (moves < 0)
+        return -1;
+    if (truncate(path, length) < 0)
+        warn("truncate(): Cannot drop the unreadable end of game journal %s", path);
+    snprintf(j->path, JOURNAL_PATH_LEN, "%s", path);
+    j->create = 0;
+    j->sinceSnapshot = 0;
+    start_writer(j);
+    return moves;
+}
@@ -0,0 +1,57 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "board.h"
+
+// ===========================================================================
+// Game journal
+// One append-only file per game: a versioned header, then a record per move played and,
+// every so many moves, a snapshot of the position in FEN. All fields are little-endian.
+//   Header:   "BORISJNL", version (2 bytes)
+//   Move:     pack_move() (2 bytes), whose top bit is always clear
+//   Snapshot: 0x8000 | length (2 bytes), then the FEN, unterminated
+// A background thread writes the records and syncs them to disk in batches,
+// so the game goes on without waiting for the file.
+// ===========================================================================
+#define JOURNAL_VERSION (1)
+// Directory new journals are created in
+#define JOURNAL_DIR "history"
+// Moves between position snapshots
+#define JOURNAL_SNAPSHOT_PLIES (32)
+// Longest that written records go without being synced to disk, in milliseconds
+#define JOURNAL_SYNC_MS (1000)
+#define JOURNAL_PATH_LEN (128)
+
+struct Journal {
+    char path[JOURNAL_PATH_LEN];
+    uint8_t create; // Whether the writer creates the file, rather than appending to it
+    int sinceSnapshot;
+
+    // Records not yet handed to the writer, and its buffer from last time to swap in
+    uint8_t* pending;
+    size_t pendingLen, pendingSize;
+    uint8_t* spare;
+    size_t spareSize;
+
+    pthread_t writer;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    uint8_t closing;
+};
+
+// Starts a new journal in JOURNAL_DIR for a game from start.
+void journal_start(struct Journal* j, const struct State* start);
+// Replays the journal at path into s, and sets keys to those of the positions before it,
+// oldest first, as far back as FIFTY_MOVE_PLIES, then carries on writing the game there.
+// Returns the moves replayed, or -1 if the file cannot be read as a journal, in which case j is not started.
+// Anything after the last good record, such as one cut short by a crash, is dropped from the file.
+int journal_resume(struct Journal* j, const char* path, struct State* s, uint64_t keys[FIFTY_MOVE_PLIES], int* nKeys);
+// Records a move, given as pack_move(), and the position it led to.
+void journal_move(struct Journal* j, uint16_t move, const struct State* after);
+// Writes out what is left and syncs it, then stops the writer.
+void journal_close(struct Journal* j);
+
+#endif // JOURNAL_H
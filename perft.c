@@ -0,0 +1,471 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "perft.h"
+#ifdef BITBOARD
+#include "bitboard.h"
+#endif // BITBOARD
+
+extern const struct State initialState;
+
+// ===========================================================================
+// Positions
+// ===========================================================================
+static const struct State perft2 = {
+    .board = {
+        WHITE|ROOK, 0, 0, 0, WHITE|KING, 0, 0, WHITE|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|PAWN, WHITE|PAWN, WHITE|PAWN, WHITE|BISHOP, WHITE|BISHOP, WHITE|PAWN, WHITE|PAWN, WHITE|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, WHITE|KNIGHT, 0, 0, WHITE|QUEEN, 0, BLACK|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, BLACK|PAWN, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, WHITE|PAWN, WHITE|KNIGHT, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|BISHOP, BLACK|KNIGHT, 0, 0, BLACK|PAWN, BLACK|KNIGHT, BLACK|PAWN, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|PAWN, 0, BLACK|PAWN, BLACK|PAWN, BLACK|QUEEN, BLACK|PAWN, BLACK|BISHOP, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|ROOK, 0, 0, 0, BLACK|KING, 0, 0, BLACK|ROOK,     0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State perft3 = {
+    .board = {
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, WHITE|PAWN, 0, WHITE|PAWN, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, WHITE|ROOK, 0, 0, 0, BLACK|PAWN, 0, BLACK|KING|PIECE_MOVED,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|KING|PIECE_MOVED, WHITE|PAWN, 0, 0, 0, 0, 0, BLACK|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, BLACK|PAWN, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, BLACK|PAWN, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State perft4 = {
+    .board = {
+        WHITE|ROOK, 0, 0, WHITE|QUEEN, 0, WHITE|ROOK, WHITE|KING|PIECE_MOVED, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|PAWN, BLACK|PAWN, 0, WHITE|PAWN, 0, 0, WHITE|PAWN, WHITE|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|QUEEN, 0, 0, 0, 0, WHITE|KNIGHT, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|BISHOP, WHITE|BISHOP, WHITE|PAWN, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|KNIGHT, WHITE|PAWN, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, BLACK|BISHOP, 0, 0, 0, BLACK|KNIGHT, BLACK|BISHOP, WHITE|KNIGHT,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|PAWN, BLACK|PAWN, BLACK|PAWN, BLACK|PAWN, 0, BLACK|PAWN, BLACK|PAWN, BLACK|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|ROOK, 0, 0, 0, BLACK|KING, 0, 0, BLACK|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State perft5 = {
+    .board = {
+        WHITE|ROOK, WHITE|KNIGHT, WHITE|BISHOP, WHITE|QUEEN, WHITE|KING, 0, 0, WHITE|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
+        WHITE|PAWN, WHITE|PAWN, WHITE|PAWN, 0, WHITE|KNIGHT, BLACK|KNIGHT, WHITE|PAWN, WHITE|PAWN,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, WHITE|BISHOP, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, BLACK|PAWN, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|PAWN, BLACK|PAWN, 0, WHITE|PAWN, BLACK|BISHOP, BLACK|PAWN, BLACK|PAWN, BLACK|PAWN,     0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|ROOK, BLACK|KNIGHT, BLACK|BISHOP, BLACK|QUEEN, 0, BLACK|KING|PIECE_MOVED, 0, BLACK|ROOK,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State promo1 = {
+    .board = {
+        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State promo2 = {
+    .board = {
+        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|KING, 0, 0, 0, BLACK|ROOK, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State promo3 = {
+    .board = {
+        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, WHITE|PAWN, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|KING, 0, 0, BLACK|ROOK, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+static const struct State promo4 = {
+    .board = {
+        WHITE|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        0, 0, 0, BLACK|PAWN, WHITE|PAWN, BLACK|PAWN, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+        BLACK|KING, 0, 0, 0, 0, 0, 0, 0,    0, 0, 0, 0, 0, 0, 0, 0,
+    }
+};
+
+// Leaf counts from https://www.chessprogramming.org/Perft_Results, indexed by depth.
+// The promotion positions have none published, so they are not in the suite.
+static const struct PerftPosition {
+    const char* name;
+    const struct State* s;
+    uint8_t suiteDepth; // Depth the suite runs it to, 0 to leave it out
+    uint64_t expected[7];
+} positions[] = {
+    {"initial", &initialState, 5, {1, 20, 400, 8902, 197281, 4865609, 119060324}},
+    {"perft2", &perft2, 4, {1, 48, 2039, 97862, 4085603, 193690690}},
+    {"perft3", &perft3, 6, {1, 14, 191, 2812, 43238, 674624, 11030083}},
+    {"perft4", &perft4, 5, {1, 6, 264, 9467, 422333, 15833292, 706045033}},
+    {"perft5", &perft5, 4, {1, 44, 1486, 62379, 2103487, 89941194}},
+    {"promo1", &promo1, 0, {0}},
+    {"promo2", &promo2, 0, {0}},
+    {"promo3", &promo3, 0, {0}},
+    {"promo4", &promo4, 0, {0}},
+};
+#define N_POSITIONS (sizeof(positions) / sizeof(positions[0]))
+
+static const struct PerftPosition* find_position(const char* name) {
+    for (size_t i = 0; i < N_POSITIONS; i++) {
+        if (strcasecmp(name, positions[i].name) == 0)
+            return &positions[i];
+    }
+    return NULL;
+}
+
+const struct State* perft_position(const char* name) {
+    const struct PerftPosition* p = find_position(name);
+    return p ? p->s : NULL;
+}
+
+// ===========================================================================
+// Counting
+// ===========================================================================
+#ifdef DEBUG
+// Checks the move generator and the incrementally kept state against a fresh computation.
+static void check_position(struct State* s) {
+#ifdef BITBOARD
+    verify_legal_moves(s);
+    struct Bitboards bb;
+    bb_from_state(s, &bb);
+    if (memcmp(&bb, &s->bb, sizeof(struct Bitboards)) != 0)
+        warnx("Incremental bitboards disagree at ply %d", s->ply);
+#endif // BITBOARD
+    if (s->key != zobrist_key(s))
+        warnx("Incremental Zobrist key disagrees at ply %d", s->ply);
+    if (s->eval != evaluate(s))
+        warnx("Incremental evaluation disagrees at ply %d", s->ply);
+}
+#endif // DEBUG
+
+uint64_t perft(struct State* s, int depth) {
+    struct Move moves[MAX_MOVES];
+    uint8_t nMoves = generate_moves(s, moves);
+#ifdef DEBUG
+    check_position(s);
+#endif // DEBUG
+
+    // Bulk counting: the moves from the last position before the leaves are the leaves.
+    if (depth <= 1)
+        return depth == 1 ? nMoves : 1;
+
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < nMoves; i++) {
+        struct Undo u;
+        make_move(s, &moves[i], &u);
+        total += perft(s, depth - 1);
+        unmake_move(s, &u);
+    }
+    return total;
+}
+
+uint64_t perft_divide(struct State* s, int depth) {
+    if (depth < 1)
+        return 1;
+    struct Move moves[MAX_MOVES];
+    uint8_t nMoves = generate_moves(s, moves);
+    uint64_t total = 0;
+    for (uint8_t i = 0; i < nMoves; i++) {
+        struct Undo u;
+        make_move(s, &moves[i], &u);
+        uint64_t nSucc = perft(s, depth - 1);
+        unmake_move(s, &u);
+
+        char algebra[ALGEBRA_LEN];
+        move_to_algebra(&moves[i], algebra);
+        printf("%s: %ld\n", algebra, nSucc);
+        total += nSucc;
+    }
+    return total;
+}
+
+// ===========================================================================
+// Parallel counting
+// The first plies are split into tasks for the pool. Below them, subtree counts are kept
+// by position and depth in a table shared by every thread, without locks: each entry stores
+// its key XORed with its data, so an entry torn by two threads writing at once fails the check.
+// ===========================================================================
+struct PerftCache {
+    uint64_t (*entries)[2]; // Key ^ data, data; data is the count above the depth in the low byte
+    uint64_t mask;
+};
+
+static uint8_t cache_probe(const struct PerftCache* c, uint64_t key, int depth, uint64_t* count) {
+    if (c->entries == NULL)
+        return 0;
+    uint64_t* e = c->entries[key & c->mask];
+    uint64_t check = __atomic_load_n(&e[0], __ATOMIC_RELAXED);
+    uint64_t data = __atomic_load_n(&e[1], __ATOMIC_RELAXED);
+    if ((check ^ data) != key || (data & 0xFF) != (uint64_t)depth)
+        return 0;
+    *count = data >> 8;
+    return 1;
+}
+
+static void cache_store(struct PerftCache* c, uint64_t key, int depth, uint64_t count) {
+    if (c->entries == NULL)
+        return;
+    uint64_t* e = c->entries[key & c->mask];
+    uint64_t data = (count << 8) | depth;
+    __atomic_store_n(&e[0], key ^ data, __ATOMIC_RELAXED);
+    __atomic_store_n(&e[1], data, __ATOMIC_RELAXED);
+}
+
+static uint64_t perft_cached(struct State* s, int depth, struct PerftCache* c) {
+    if (depth == 0)
+        return 1;
+    uint64_t total = 0;
+    if (depth >= 2 && cache_probe(c, s->key, depth, &total))
+        return total;
+
+    struct Move moves[MAX_MOVES];
+    uint8_t nMoves = generate_moves(s, moves);
+#ifdef DEBUG
+    check_position(s);
+#endif // DEBUG
+    if (depth == 1)
+        return nMoves;
+    for (uint8_t i = 0; i < nMoves; i++) {
+        struct Undo u;
+        make_move(s, &moves[i], &u);
+        total += perft_cached(s, depth - 1, c);
+        unmake_move(s, &u);
+    }
+    cache_store(c, s->key, depth, total);
+    return total;
+}
+
+// A subtree for one worker: the position after the split plies, and what was counted below it.
+struct PerftTask {
+    struct State s;
+    int depth;
+    uint8_t rootMove; // Which root move it is below, for the divide
+    struct PerftCache* cache;
+    uint64_t count;
+};
+
+static void perft_task(void* args) {
+    struct PerftTask* task = (struct PerftTask*)args;
+    task->count = perft_cached(&task->s, task->depth, task->cache);
+}
+
+uint64_t perft_parallel(struct Pool* pool, const struct State* s0, int depth, size_t cacheBytes, uint8_t divide) {
+    if (depth < 1)
+        return 1;
+    struct PerftCache cache = {NULL, 0};
+    if (cacheBytes >= 2 * sizeof(uint64_t)) {
+        // The largest power of two entries that fits
+        uint64_t n = 1;
+        while (2 * n * 2 * sizeof(uint64_t) <= cacheBytes)
+            n *= 2;
+        cache.entries = calloc(n, 2 * sizeof(uint64_t));
+        if (cache.entries == NULL)
+            err(1, "calloc(): Cannot allocate perft cache");
+        cache.mask = n - 1;
+    }
+
+    // Split two plies deep where there are enough below them, so each worker has many tasks to balance.
+    int split = depth >= 3 ? 2 : 1;
+    struct State s;
+    memcpy(&s, s0, sizeof(struct State));
+    struct Move rootMoves[MAX_MOVES];
+    uint8_t nRoot = generate_moves(&s, rootMoves);
+
+    uint32_t nTasks = 0, capacity = MAX_MOVES;
+    struct PerftTask* tasks = malloc(capacity * sizeof(struct PerftTask));
+    if (tasks == NULL)
+        err(1, "malloc(): Cannot allocate perft tasks");
+    for (uint8_t i = 0; i < nRoot; i++) {
+        struct Undo u;
+        make_move(&s, &rootMoves[i], &u);
+        struct Move replies[MAX_MOVES];
+        uint8_t nReplies = split == 2 ? generate_moves(&s, replies) : 1;
+        if (nTasks + nReplies > capacity) {
+            capacity *= 2;
+            tasks = realloc(tasks, capacity * sizeof(struct PerftTask));
+            if (tasks == NULL)
+                err(1, "realloc(): Cannot allocate perft tasks");
+        }
+        for (uint8_t j = 0; j < nReplies; j++) {
+            struct PerftTask* task = &tasks[nTasks++];
+            memcpy(&task->s, &s, sizeof(struct State));
+            if (split == 2) {
+                struct Undo v;
+                make_move(&task->s, &replies[j], &v);
+            }
+            task->depth = depth - split;
+            task->rootMove = i;
+            task->cache = &cache;
+            task->count = 0;
+        }
+        unmake_move(&s, &u);
+    }
+
+    void** args = malloc(nTasks * sizeof(void*));
+    if (args == NULL)
+        err(1, "malloc(): Cannot allocate perft tasks");
+    for (uint32_t i = 0; i < nTasks; i++)
+        args[i] = &tasks[i];
+    struct PoolGroup group = {0};
+    pool_submit(pool, perft_task, args, nTasks, &group);
+    pool_wait(pool, &group);
+
+    uint64_t total = 0;
+    uint32_t t = 0;
+    for (uint8_t i = 0; i < nRoot; i++) {
+        uint64_t nSucc = 0;
+        for (; t < nTasks && tasks[t].rootMove == i; t++)
+            nSucc += tasks[t].count;
+        if (divide) {
+            char algebra[ALGEBRA_LEN];
+            move_to_algebra(&rootMoves[i], algebra);
+            printf("%s: %ld\n", algebra, nSucc);
+        }
+        total += nSucc;
+    }
+    free(args);
+    free(tasks);
+    free(cache.entries);
+    return total;
+}
+
+static double seconds_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
+}
+
+// ===========================================================================
+// Command line
+// ===========================================================================
+static int run_suite(struct Pool* pool, size_t cacheBytes) {
+    int failures = 0;
+    uint64_t totalNodes = 0;
+    double totalSeconds = 0;
+    for (size_t i = 0; i < N_POSITIONS; i++) {
+        const struct PerftPosition* p = &positions[i];
+        if (p->suiteDepth == 0)
+            continue;
+        struct State s;
+        memcpy(&s, p->s, sizeof(struct State));
+        refresh_state(&s);
+
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t nodes = perft_parallel(pool, &s, p->suiteDepth, cacheBytes, 0);
+        double seconds = seconds_since(&start);
+
+        uint8_t ok = nodes == p->expected[p->suiteDepth];
+        failures += !ok;
+        totalNodes += nodes;
+        totalSeconds += seconds;
+        printf("%-8s depth %d: %12ld %-8s %8.3f s %8.2f Mnodes/s\n", p->name, p->suiteDepth, nodes,
+                ok ? "OK" : "MISMATCH", seconds, nodes / seconds / 1e6);
+    }
+    printf("Total: %ld nodes in %.3f s, %.2f Mnodes/s, %d failed\n", totalNodes, totalSeconds,
+            totalNodes / totalSeconds / 1e6, failures);
+    return failures != 0;
+}
+
+static int usage(void) {
+    fprintf(stderr, "Usage: boris perft [-j threads] [-c cache MiB] <depth> [position or FEN]\n"
+            "       boris perft [-j threads] [-c cache MiB] suite\nPositions:");
+    for (size_t i = 0; i < N_POSITIONS; i++)
+        fprintf(stderr, " %s", positions[i].name);
+    fprintf(stderr, "\n");
+    return 1;
+}
+
+int perft_main(int argc, char** argv) {
+    int nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    size_t cacheBytes = PERFT_CACHE_MIB << 20;
+    int arg = 0;
+    for (; arg + 1 < argc && argv[arg][0] == '-'; arg += 2) {
+        if (strcmp(argv[arg], "-j") == 0)
+            nthreads = atoi(argv[arg + 1]);
+        else if (strcmp(argv[arg], "-c") == 0)
+            cacheBytes = (size_t)atoi(argv[arg + 1]) << 20;
+        else
+            return usage();
+    }
+    if (nthreads < 1)
+        nthreads = 1;
+    argc -= arg;
+    argv += arg;
+
+    // A built-in position, whose counts are known, or any FEN
+    const struct PerftPosition* p = NULL;
+    struct State s;
+    int depth = 0;
+    uint8_t suite = argc >= 1 && strcasecmp(argv[0], "suite") == 0;
+    if (!suite) {
+        depth = argc >= 1 ? atoi(argv[0]) : 0;
+        const char* position = argc >= 2 ? argv[1] : "initial";
+        p = find_position(position);
+        if (p != NULL) {
+            memcpy(&s, p->s, sizeof(struct State));
+            refresh_state(&s);
+        } else if (state_from_fen(&s, position) == NULL) {
+            fprintf(stderr, "Not a position name or legal FEN: %s\n", position);
+            return usage();
+        }
+        if (depth < 1)
+            return usage();
+    }
+
+    struct Pool pool;
+    pool_init(&pool, nthreads);
+    int status = 0;
+    if (suite) {
+        status = run_suite(&pool, cacheBytes);
+    } else {
+        struct timespec start;
+        clock_gettime(CLOCK_MONOTONIC, &start);
+        uint64_t nodes = perft_parallel(&pool, &s, depth, cacheBytes, 1);
+        double seconds = seconds_since(&start);
+
+        printf("\nNodes: %ld\nTime: %.9f s\nSpeed: %.0f nodes/s\n", nodes, seconds, nodes / seconds);
+        if (p != NULL && depth < 7 && p->expected[depth]) {
+            uint8_t ok = nodes == p->expected[depth];
+            printf("Expected: %ld %s\n", p->expected[depth], ok ? "OK" : "MISMATCH");
+            status = !ok;
+        }
+    }
+    pool_destroy(&pool);
+    return status;
+}
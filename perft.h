@@ -0,0 +1,35 @@
+#ifndef PERFT_H
+#define PERFT_H
+
+#include <stdint.h>
+
+#include "board.h"
+#include "pool.h"
+
+// ===========================================================================
+// Performance tests (perft)
+// Counts the leaves of the legal move tree to a fixed depth, to check the move generators
+// against published counts and to time them.
+// https://www.chessprogramming.org/Perft_Results
+// ===========================================================================
+// The built-in position with this name, or NULL.
+const struct State* perft_position(const char* name);
+
+// Leaves of the move tree depth plies below s. s is played on and restored.
+// Debug builds also check the incremental key and evaluation at every position above the leaves.
+uint64_t perft(struct State* s, int depth);
+// Same, also printing the count below each move.
+uint64_t perft_divide(struct State* s, int depth);
+
+// Same, split across the pool's workers, with subtree counts shared through a table of cacheBytes
+// (none if zero). Prints the count below each root move if divide is set.
+uint64_t perft_parallel(struct Pool* pool, const struct State* s, int depth, size_t cacheBytes, uint8_t divide);
+// Default size of that table.
+#define PERFT_CACHE_MIB (64)
+
+// `boris perft [-j threads] [-c cache MiB] <depth> [position or FEN]` and `boris perft suite`,
+// given the arguments after "perft".
+// Returns the exit status: non-zero if a count differs from the published one.
+int perft_main(int argc, char** argv);
+
+#endif // PERFT_H
@@ -0,0 +1,68 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "playout.h"
+
+// xorshift64*: a few cycles per number, and no shared state between threads.
+static uint64_t next_random(uint64_t* rng) {
+    uint64_t x = *rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    *rng = x;
+    return x * 0x2545F4914F6CDD1DULL;
+}
+
+uint64_t playout_seed(uint64_t seed) {
+    // Any seed but zero, spread over the bits.
+    uint64_t rng = seed * 0x9E3779B97F4A7C15ULL;
+    return rng ? rng : 1;
+}
+
+// Scores a playout cut before the end of the game.
+static int8_t score_eval(int16_t eval) {
+    if (eval >= PLAYOUT_WIN_MARGIN)
+        return 1;
+    if (eval <= -PLAYOUT_WIN_MARGIN)
+        return -1;
+    return 0;
+}
+
+int8_t playout(const struct State* s0, const struct PlayoutLimits* limits, uint64_t* keys, int n,
+        uint64_t* rng, uint64_t* plies) {
+    struct State s;
+    memcpy(&s, s0, sizeof(struct State));
+    struct Move moves[MAX_MOVES];
+    int maxPlies = (limits->maxPlies && limits->maxPlies < PLAYOUT_MAX_PLIES) ? limits->maxPlies : PLAYOUT_MAX_PLIES;
+
+    for (int i = 0; i < maxPlies; i++) {
+        // Swings are measured after whole moves, so an exchange half done does not count.
+        if (limits->swing && i % 2 == 0 && abs(s.eval - s0->eval) >= limits->swing) {
+            *plies += i;
+            return score_eval(s.eval);
+        }
+
+        uint8_t nMoves = generate_moves(&s, moves);
+        if (nMoves == 0) {
+            *plies += i;
+            // The game has finished. Checkmate, otherwise stalemate.
+            if (is_in_check(&s))
+                return BLACK_TO_MOVE(&s) ? 1 : -1;
+            return 0;
+        }
+        if (is_draw_by_rule(&s, keys, n)) {
+            *plies += i;
+            return 0;
+        }
+        // Scale the top 32 bits into range rather than dividing.
+        uint32_t pick = ((next_random(rng) >> 32) * nMoves) >> 32;
+        struct Undo u;
+        keys[n++] = s.key;
+        make_move(&s, &moves[pick], &u);
+    }
+    *plies += maxPlies;
+    if (limits->maxPlies)
+        return score_eval(s.eval);
+    // The game didn't finish within the move limit: a draw.
+    return 0;
+}
@@ -0,0 +1,35 @@
+#ifndef PLAYOUT_H
+#define PLAYOUT_H
+
+#include <stdint.h>
+
+#include "board.h"
+
+// ===========================================================================
+// Playouts
+// Random games played out on a single board, with the legal moves in a buffer on the stack.
+// Nothing is allocated or formatted along the way.
+// ===========================================================================
+// Moves played before a game is called a draw.
+#define PLAYOUT_MAX_PLIES (200)
+
+// When to cut a playout short and score it from the static evaluation instead.
+struct PlayoutLimits {
+    uint16_t maxPlies; // Plies before the cut, at most PLAYOUT_MAX_PLIES; 0 to play to the end of the game
+    int16_t swing;     // Cut once the evaluation has moved this far from the start, in centipawns; 0 for never
+};
+
+// A cut playout is a win for the side ahead by at least this much, otherwise a draw.
+#define PLAYOUT_WIN_MARGIN (150)
+
+// Seeds a generator for playout(). Each thread needs its own.
+uint64_t playout_seed(uint64_t seed);
+
+// Plays random moves from s until the game ends or the limits cut it, adding the number played to *plies.
+// A game also ends drawn by the fifty-move rule or threefold repetition: keys holds the n positions
+// leading to s, oldest first, and has room for PLAYOUT_MAX_PLIES more.
+// Returns 1 if White won, -1 if Black won, 0 for a draw.
+int8_t playout(const struct State* s, const struct PlayoutLimits* limits, uint64_t* keys, int n,
+        uint64_t* rng, uint64_t* plies);
+
+#endif // PLAYOUT_H
@@ -0,0 +1,270 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+#include <time.h>
+
+#include "pool.h"
+#include "trace.h"
+
+#define DEQUE_MASK ((1 << POOL_DEQUE_BITS) - 1)
+
+struct WorkerArgs {
+    struct Pool* p;
+    int index;
+};
+
+static __thread int workerIndex = -1;
+
+int pool_worker_index(void) {
+    return workerIndex;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+uint64_t pool_idle_ns(const struct Pool* p, int i) {
+    uint64_t ns = __atomic_load_n(&p->idle[i].ns, __ATOMIC_RELAXED);
+    uint64_t since = __atomic_load_n(&p->idle[i].parkedSince, __ATOMIC_RELAXED);
+    return since ? ns + (now_ns() - since) : ns;
+}
+
+// ===========================================================================
+// Work-stealing deque
+// After Le et al., "Correct and Efficient Work-Stealing for Weak Memory Models" (2013).
+// ===========================================================================
+// Owner only. Returns 0 if the deque is full.
+static uint8_t deque_push(struct PoolDeque* d, const struct PoolTask* task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    if (b - t > DEQUE_MASK)
+        return 0;
+    memcpy(&d->tasks[b & DEQUE_MASK], task, sizeof(struct PoolTask));
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return 1;
+}
+
+// Owner only: the newest task. Returns 0 if the deque is empty.
+static uint8_t deque_take(struct PoolDeque* d, struct PoolTask* task) {
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_RELAXED) - 1;
+    __atomic_store_n(&d->bottom, b, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_RELAXED);
+    if (t > b) {
+        // Empty
+        __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+        return 0;
+    }
+    memcpy(task, &d->tasks[b & DEQUE_MASK], sizeof(struct PoolTask));
+    if (t < b)
+        return 1;
+    // The last task: race the thieves for it.
+    uint8_t won = __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+    __atomic_store_n(&d->bottom, b + 1, __ATOMIC_RELAXED);
+    return won;
+}
+
+// Any thread: the oldest task. Returns 0 if the deque is empty or another thread took it first.
+static uint8_t deque_steal(struct PoolDeque* d, struct PoolTask* task) {
+    int64_t t = __atomic_load_n(&d->top, __ATOMIC_ACQUIRE);
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    int64_t b = __atomic_load_n(&d->bottom, __ATOMIC_ACQUIRE);
+    if (t >= b)
+        return 0;
+    memcpy(task, &d->tasks[t & DEQUE_MASK], sizeof(struct PoolTask));
+    return __atomic_compare_exchange_n(&d->top, &t, t + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_RELAXED);
+}
+
+// ===========================================================================
+// Workers
+// ===========================================================================
+// Wakes parked workers if there are any. Called after tasks are queued.
+static void wake_workers(struct Pool* p) {
+    if (__atomic_load_n(&p->sleepers, __ATOMIC_SEQ_CST) == 0)
+        return;
+    pthread_mutex_lock(&p->lock);
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+}
+
+// Finds a task for worker self (-1 outside the pool): its own first, then the shared queue, then stealing.
+static uint8_t find_task(struct Pool* p, int self, struct PoolTask* task) {
+    if (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0)
+        return 0;
+    uint8_t found = 0;
+    if (self >= 0)
+        found = deque_take(&p->deques[self], task);
+    if (!found && __atomic_load_n(&p->injectedCount, __ATOMIC_RELAXED)) {
+        pthread_mutex_lock(&p->lock);
+        if (p->injectedCount) {
+            memcpy(task, &p->injected[p->injectedHead], sizeof(struct PoolTask));
+            p->injectedHead = (p->injectedHead + 1) % p->injectedSize;
+            __atomic_store_n(&p->injectedCount, p->injectedCount - 1, __ATOMIC_RELAXED);
+            found = 1;
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    for (int i = 1; !found && i <= p->nthreads; i++) {
+        int victim = (self + i) % p->nthreads;
+        if (victim != self)
+            found = deque_steal(&p->deques[victim], task);
+    }
+    if (found)
+        __atomic_fetch_sub(&p->queued, 1, __ATOMIC_SEQ_CST);
+    return found;
+}
+
+static void run_task(struct Pool* p, const struct PoolTask* task) {
+    TRACE_BEGIN(TRACE_TASK);
+    task->run(task->arg);
+    TRACE_END(TRACE_TASK);
+    if (__atomic_sub_fetch(&task->group->pending, 1, __ATOMIC_ACQ_REL) == 0) {
+        pthread_mutex_lock(&p->lock);
+        pthread_cond_broadcast(&p->done);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
+
+static void* worker_main(void* args) {
+    struct Pool* p = ((struct WorkerArgs*)args)->p;
+    workerIndex = ((struct WorkerArgs*)args)->index;
+    free(args);
+
+    for (;;) {
+        struct PoolTask task;
+        if (find_task(p, workerIndex, &task)) {
+            run_task(p, &task);
+            continue;
+        }
+
+        // Park until something is queued. Announcing the sleeper before looking at the queue again
+        // means a submitter either sees it and wakes us, or we see its tasks.
+        struct PoolIdle* idle = &p->idle[workerIndex];
+        uint64_t parked = now_ns();
+        __atomic_store_n(&idle->parkedSince, parked, __ATOMIC_RELAXED);
+        TRACE_BEGIN(TRACE_PARK);
+        pthread_mutex_lock(&p->lock);
+        __atomic_fetch_add(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+        while (__atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0 && !p->shutdown)
+            pthread_cond_wait(&p->wake, &p->lock);
+        __atomic_fetch_sub(&p->sleepers, 1, __ATOMIC_SEQ_CST);
+        TRACE_END(TRACE_PARK);
+        __atomic_store_n(&idle->ns, idle->ns + (now_ns() - parked), __ATOMIC_RELAXED);
+        __atomic_store_n(&idle->parkedSince, 0, __ATOMIC_RELAXED);
+        uint8_t stop = p->shutdown && __atomic_load_n(&p->queued, __ATOMIC_SEQ_CST) == 0;
+        pthread_mutex_unlock(&p->lock);
+        if (stop)
+            break;
+    }
+    return NULL;
+}
+
+void pool_init(struct Pool* p, int nthreads) {
+    memset(p, 0, sizeof(struct Pool));
+    p->nthreads = nthreads;
+    p->deques = calloc(nthreads, sizeof(struct PoolDeque));
+    p->threads = malloc(nthreads * sizeof(pthread_t));
+    p->idle = calloc(nthreads, sizeof(struct PoolIdle));
+    if (p->deques == NULL || p->threads == NULL || p->idle == NULL)
+        err(1, "malloc(): Cannot allocate worker threads");
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->wake, NULL);
+    pthread_cond_init(&p->done, NULL);
+
+    for (int i = 0; i < nthreads; i++) {
+        struct WorkerArgs* args = malloc(sizeof(struct WorkerArgs));
+        if (args == NULL)
+            err(1, "malloc(): Cannot allocate worker threads");
+        args->p = p;
+        args->index = i;
+        if (pthread_create(&p->threads[i], NULL, worker_main, args) != 0)
+            errx(1, "pthread_create(): Cannot start worker thread");
+    }
+}
+
+void pool_destroy(struct Pool* p) {
+    pthread_mutex_lock(&p->lock);
+    p->shutdown = 1;
+    pthread_cond_broadcast(&p->wake);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->nthreads; i++)
+        pthread_join(p->threads[i], NULL);
+
+    pthread_mutex_destroy(&p->lock);
+    pthread_cond_destroy(&p->wake);
+    pthread_cond_destroy(&p->done);
+    free(p->threads);
+    free(p->deques);
+    free(p->idle);
+    free(p->injected);
+}
+
+// ===========================================================================
+// Submitting and waiting
+// ===========================================================================
+// Appends tasks to the shared queue. Caller holds the lock.
+static void inject(struct Pool* p, const struct PoolTask* task) {
+    if (p->injectedCount == p->injectedSize) {
+        // Grow, unwrapping the ring into the new buffer.
+        uint32_t size = p->injectedSize ? 2 * p->injectedSize : 64;
+        struct PoolTask* ring = malloc(size * sizeof(struct PoolTask));
+        if (ring == NULL)
+            err(1, "malloc(): Cannot queue task");
+        for (uint32_t i = 0; i < p->injectedCount; i++)
+            ring[i] = p->injected[(p->injectedHead + i) % p->injectedSize];
+        free(p->injected);
+        p->injected = ring;
+        p->injectedSize = size;
+        p->injectedHead = 0;
+    }
+    p->injected[(p->injectedHead + p->injectedCount) % p->injectedSize] = *task;
+    __atomic_store_n(&p->injectedCount, p->injectedCount + 1, __ATOMIC_RELAXED);
+}
+
+void pool_submit(struct Pool* p, void (*func)(void*), void** args, uint32_t n, struct PoolGroup* group) {
+    if (n == 0)
+        return;
+    // Counted before they are visible, so neither count can drop below zero.
+    __atomic_fetch_add(&group->pending, n, __ATOMIC_ACQ_REL);
+    __atomic_fetch_add(&p->queued, n, __ATOMIC_SEQ_CST);
+
+    int self = workerIndex;
+    uint32_t i = 0;
+    if (self >= 0) {
+        for (; i < n; i++) {
+            struct PoolTask task = {.run = func, .arg = args[i], .group = group};
+            if (!deque_push(&p->deques[self], &task))
+                break; // Full: the rest go on the shared queue.
+        }
+    }
+    if (i < n) {
+        pthread_mutex_lock(&p->lock);
+        for (; i < n; i++) {
+            struct PoolTask task = {.run = func, .arg = args[i], .group = group};
+            inject(p, &task);
+        }
+        pthread_mutex_unlock(&p->lock);
+    }
+    wake_workers(p);
+}
+
+void pool_wait(struct Pool* p, struct PoolGroup* group) {
+    int self = workerIndex;
+    while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE)) {
+        if (self >= 0) {
+            // Help rather than block the worker.
+            struct PoolTask task;
+            if (find_task(p, self, &task))
+                run_task(p, &task);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while (__atomic_load_n(&group->pending, __ATOMIC_ACQUIRE))
+            pthread_cond_wait(&p->done, &p->lock);
+        pthread_mutex_unlock(&p->lock);
+    }
+}
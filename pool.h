@@ -0,0 +1,73 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+// ===========================================================================
+// Job system
+// A fixed set of worker threads, each with its own lock-free deque of tasks.
+// A worker runs its own tasks newest first and steals the oldest from the others when it runs out.
+// Tasks from outside the pool go through one shared queue, a batch per lock.
+// Idle workers park on a condition variable instead of spinning.
+// ===========================================================================
+// Tasks queued at once in each worker's deque, as a power of two.
+#define POOL_DEQUE_BITS (12)
+
+// Counts the tasks of one submission, or several, that have yet to finish.
+struct PoolGroup {
+    uint32_t pending;
+};
+
+struct PoolTask {
+    void (*run)(void* arg);
+    void* arg;
+    struct PoolGroup* group;
+};
+
+// Chase-Lev work-stealing deque: the owner pushes and takes at the bottom, thieves take from the top.
+struct PoolDeque {
+    int64_t top, bottom;
+    struct PoolTask tasks[1 << POOL_DEQUE_BITS];
+};
+
+// Time a worker has spent parked, waiting for tasks.
+struct PoolIdle {
+    uint64_t ns;          // Before the current wait
+    uint64_t parkedSince; // Monotonic clock, in ns; 0 while it has work
+};
+
+struct Pool {
+    int nthreads;
+    pthread_t* threads;
+    struct PoolDeque* deques;
+    struct PoolIdle* idle; // Per worker
+
+    // Tasks submitted from outside the pool: a ring buffer that grows as needed.
+    struct PoolTask* injected;
+    uint32_t injectedHead, injectedCount, injectedSize;
+
+    uint32_t queued;   // Tasks in any queue, not yet started
+    uint32_t sleepers; // Workers parked on wake
+    uint8_t shutdown;
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // Tasks have been queued, or the pool is shutting down
+    pthread_cond_t done; // A group has finished
+};
+
+void pool_init(struct Pool* p, int nthreads);
+// Finishes the queued tasks, then stops every worker.
+void pool_destroy(struct Pool* p);
+
+// Queues n tasks to run func on each of args[0..n-1], counting them in group.
+// From a worker, they go on its own deque for others to steal; from outside, onto the shared queue.
+void pool_submit(struct Pool* p, void (*func)(void*), void** args, uint32_t n, struct PoolGroup* group);
+// Returns once every task counted in group has finished. A worker runs other tasks while it waits.
+void pool_wait(struct Pool* p, struct PoolGroup* group);
+
+// Index of the worker running the calling thread, or -1 outside the pool.
+int pool_worker_index(void);
+// Nanoseconds worker i has spent parked since the pool started, including any wait in progress.
+uint64_t pool_idle_ns(const struct Pool* p, int i);
+
+#endif // POOL_H
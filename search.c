@@ -0,0 +1,289 @@
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "search.h"
+#include "trace.h"
+
+// ===========================================================================
+// Monte Carlo tree search
+// ===========================================================================
+// Using Upper-Confidence Bound for Trees.
+// wins and losses are from the point of view of the player choosing between the siblings.
+static double ucb(uint32_t visits, uint32_t wins, uint32_t losses, uint32_t parentVisits) {
+    double exploit = (double)((int64_t)wins - losses) / (double)visits;
+    double c = 0.5;
+    double explore = c * (sqrt(log(parentVisits) / visits));
+    return exploit + explore;
+}
+
+// Longest path from the root that selection follows.
+#define MAX_DEPTH (256)
+
+// Descends from the root to a position that has yet to be played out, recording the nodes passed through.
+// s starts as the root position and ends as that position, and the keys of the positions before it are
+// appended to keys. A position drawn by rule ends the descent with *drawn set; any repetition counts.
+// *fresh is set if the descent ends at a position no iteration had reached before.
+// Returns the length of the path, which includes the root.
+// Each node passed through gets a virtual visit, and counts as a loss for the player who moved into it
+// until backpropagation replaces it with the result. Other threads are steered away from the same line.
+static int selection(struct Tree* t, struct State* s, struct Node** path, uint64_t* keys, int* n, uint8_t* drawn,
+        uint8_t* fresh) {
+    struct Node* node = t->rootNode;
+    int depth = 0;
+    path[depth++] = node;
+    STAT_ADD(node->visits, 1);
+
+    for (;;) {
+        // At the memory limit the tree stops growing: play out from its leaves.
+        if (__atomic_load_n(&node->children, __ATOMIC_ACQUIRE) == NULL && tree_full(t))
+            return depth;
+        // Ensure all successors have been simulated
+        struct Children* c = tree_expand(t, node, s);
+        if (c->n == 0 || depth == MAX_DEPTH) {
+            // End of a game.
+            return depth;
+        }
+        if (s->halfmoveClock >= FIFTY_MOVE_PLIES) {
+            *drawn = 1;
+            return depth;
+        }
+
+        // Pick a successor to recurse.
+        // Whatever move has the best advantage for the person to play.
+        uint8_t selected = 0;
+        double umax = -INFINITY;
+        uint8_t black = BLACK_TO_MOVE(s);
+        uint32_t parentVisits = STAT_LOAD(node->visits);
+        for (uint8_t i = 0; i < c->n; i++) {
+            struct Node* child = __atomic_load_n(&c->node[i], __ATOMIC_ACQUIRE);
+            uint32_t visits = child ? STAT_LOAD(child->visits) : 0;
+            if (visits == 0) {
+                // Base case: Not simulated yet.
+                selected = i;
+                break;
+            }
+            uint32_t wins = black ? STAT_LOAD(child->winsB) : STAT_LOAD(child->winsW);
+            uint32_t losses = black ? STAT_LOAD(child->winsW) : STAT_LOAD(child->winsB);
+            double u = ucb(visits, wins, losses, parentVisits);
+            if (u > umax) {
+                selected = i;
+                umax = u;
+            }
+        }
+
+        struct Move m;
+        struct Undo u;
+        unpack_move(s, c->move[selected], &m);
+        keys[(*n)++] = s->key;
+        make_move(s, &m, &u);
+
+        // Transposed lines meet at the same node.
+        struct Node* child = __atomic_load_n(&c->node[selected], __ATOMIC_ACQUIRE);
+        if (child == NULL) {
+            child = tree_full(t) ? NULL : tree_find(t, s->key);
+            if (child == NULL)
+                return depth; // No room for the position: play it out without recording it.
+            __atomic_store_n(&c->node[selected], child, __ATOMIC_RELEASE);
+        }
+        path[depth++] = child;
+
+        if (black)
+            STAT_ADD(child->winsW, 1);
+        else
+            STAT_ADD(child->winsB, 1);
+        uint32_t visits = STAT_ADD(child->visits, 1);
+        // The line returns to an earlier position: treat it as drawn rather than search round the cycle.
+        if (count_repetitions(s, keys, *n)) {
+            *drawn = 1;
+            return depth;
+        }
+        if (visits == 0) {
+            *fresh = 1;
+            return depth;
+        }
+        node = child;
+    }
+}
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void mcts_iter(struct Tree* t, const struct PlayoutLimits* limits, struct Worker* w) {
+    struct SearchStats* stats = &w->stats;
+    uint64_t start = now_ns();
+
+    // SELECTION: Using upper-confidence bound
+    struct Node* path[MAX_DEPTH];
+    struct State s;
+    memcpy(&s, &t->root, sizeof(struct State));
+    // Positions leading to each one on the path and in the playout, for the draw rules.
+    uint64_t keys[FIFTY_MOVE_PLIES + MAX_DEPTH + PLAYOUT_MAX_PLIES];
+    int n = t->historyLen;
+    memcpy(keys, t->history, n * sizeof(uint64_t));
+    uint8_t drawn = 0, fresh = 0;
+    TRACE_BEGIN(TRACE_SELECT);
+    int depth = selection(t, &s, path, keys, &n, &drawn, &fresh);
+    TRACE_END(TRACE_SELECT);
+    uint64_t selected = now_ns();
+
+    // SIMULATION
+    int8_t result = 0;
+    if (!drawn) {
+        uint64_t plies = 0;
+        TRACE_BEGIN(TRACE_PLAYOUT);
+        result = playout(&s, limits, keys, n, &w->rng, &plies);
+        TRACE_END(TRACE_PLAYOUT);
+        COUNTER_ADD(stats->playouts, 1);
+        COUNTER_ADD(stats->plies, plies);
+    }
+    uint64_t simulated = now_ns();
+
+    // BACKPROPROGATION
+    // The visits were counted on the way down; swap each virtual loss for the result.
+    TRACE_BEGIN(TRACE_BACKPROP);
+    for (int d = 0; d < depth; d++) {
+        if (d > 0) {
+            uint8_t blackMovedIn = (t->root.ply + d + 1) % 2;
+            if (blackMovedIn)
+                STAT_SUB(path[d]->winsW, 1);
+            else
+                STAT_SUB(path[d]->winsB, 1);
+        }
+        if (result > 0)
+            STAT_ADD(path[d]->winsW, 1);
+        else if (result < 0)
+            STAT_ADD(path[d]->winsB, 1);
+    }
+    TRACE_END(TRACE_BACKPROP);
+
+    COUNTER_ADD(stats->iterations, 1);
+    COUNTER_ADD(stats->newNodes, fresh);
+    COUNTER_ADD(stats->depth, depth);
+    if ((uint64_t)depth > stats->maxDepth)
+        __atomic_store_n(&stats->maxDepth, depth, __ATOMIC_RELAXED);
+    COUNTER_ADD(stats->selectNs, selected - start);
+    COUNTER_ADD(stats->playoutNs, simulated - selected);
+    COUNTER_ADD(stats->backpropNs, now_ns() - simulated);
+}
+
+void root_move_stats(const struct Tree* t, uint8_t i, struct MoveStats* ms) {
+    struct Children* c = __atomic_load_n(&t->rootNode->children, __ATOMIC_ACQUIRE);
+    // The search may still be running.
+    struct Node* child = __atomic_load_n(&c->node[i], __ATOMIC_ACQUIRE);
+    uint32_t winsW = 0, winsB = 0;
+    ms->visits = 0;
+    if (child != NULL) {
+        ms->visits = STAT_LOAD(child->visits);
+        winsW = STAT_LOAD(child->winsW);
+        winsB = STAT_LOAD(child->winsB);
+    }
+    ms->wins = BLACK_TO_MOVE(&t->root) ? winsB : winsW;
+    ms->losses = BLACK_TO_MOVE(&t->root) ? winsW : winsB;
+    ms->advantage = (double)((int64_t)ms->wins - ms->losses) / (double)ms->visits;
+}
+
+int most_visited(const struct Children* c) {
+    int best = -1;
+    uint32_t bestVisits = 0;
+    for (uint8_t i = 0; i < c->n; i++) {
+        struct Node* child = __atomic_load_n(&c->node[i], __ATOMIC_ACQUIRE);
+        uint32_t visits = child ? STAT_LOAD(child->visits) : 0;
+        if (visits > bestVisits) {
+            best = i;
+            bestVisits = visits;
+        }
+    }
+    return best;
+}
+
+// ===========================================================================
+// Instrumentation
+// ===========================================================================
+void stats_reset(struct Worker* workers, int n, const struct Pool* pool) {
+    for (int i = 0; i < n; i++) {
+        memset(&workers[i].stats, 0, sizeof(struct SearchStats));
+        workers[i].idleBase = pool_idle_ns(pool, i);
+    }
+}
+
+// A snapshot of one worker's counters, or their sum.
+static void stats_load(const struct SearchStats* from, struct SearchStats* into) {
+    into->iterations += COUNTER_LOAD(from->iterations);
+    into->playouts += COUNTER_LOAD(from->playouts);
+    into->plies += COUNTER_LOAD(from->plies);
+    into->newNodes += COUNTER_LOAD(from->newNodes);
+    into->depth += COUNTER_LOAD(from->depth);
+    uint64_t maxDepth = COUNTER_LOAD(from->maxDepth);
+    if (maxDepth > into->maxDepth)
+        into->maxDepth = maxDepth;
+    into->selectNs += COUNTER_LOAD(from->selectNs);
+    into->playoutNs += COUNTER_LOAD(from->playoutNs);
+    into->backpropNs += COUNTER_LOAD(from->backpropNs);
+}
+
+static void stats_json(FILE* f, const struct SearchStats* s, uint64_t idleNs) {
+    fprintf(f, "\"iterations\":%lu,\"playouts\":%lu,\"plies\":%lu,\"newNodes\":%lu,\"depth\":%lu,\"maxDepth\":%lu,"
+            "\"selectNs\":%lu,\"playoutNs\":%lu,\"backpropNs\":%lu,\"idleNs\":%lu",
+            s->iterations, s->playouts, s->plies, s->newNodes, s->depth, s->maxDepth,
+            s->selectNs, s->playoutNs, s->backpropNs, idleNs);
+}
+
+static void stats_row(FILE* f, const char* name, const struct SearchStats* s, uint64_t idleNs) {
+    double ns = s->selectNs + s->playoutNs + s->backpropNs + idleNs;
+    if (ns == 0)
+        ns = 1;
+    fprintf(f, "%-7s %11lu %11lu %7.1f %7.1f %7lu %8.1f %8.1f %8.1f %8.1f\n", name, s->iterations, s->playouts,
+            s->playouts ? (double)s->plies / s->playouts : 0.0, s->iterations ? (double)s->depth / s->iterations : 0.0,
+            s->maxDepth, 100 * s->selectNs / ns, 100 * s->playoutNs / ns, 100 * s->backpropNs / ns, 100 * idleNs / ns);
+}
+
+void stats_report(FILE* f, uint8_t json, struct Tree* t, const struct Worker* workers, int n,
+        const struct Pool* pool, double seconds) {
+    struct SearchStats total, each[n];
+    uint64_t idle[n], totalIdle = 0;
+    memset(&total, 0, sizeof(struct SearchStats));
+    memset(each, 0, sizeof(each));
+    for (int i = 0; i < n; i++) {
+        stats_load(&workers[i].stats, &each[i]);
+        stats_load(&workers[i].stats, &total);
+        // The pool counts on once the search stops; a worker cannot have idled longer than it was not busy.
+        idle[i] = pool_idle_ns(pool, i) - workers[i].idleBase;
+        uint64_t busy = each[i].selectNs + each[i].playoutNs + each[i].backpropNs;
+        uint64_t wall = seconds * 1e9;
+        if (busy + idle[i] > wall)
+            idle[i] = wall > busy ? wall - busy : 0;
+        totalIdle += idle[i];
+    }
+    uint64_t nodes = __atomic_load_n(&t->nodes, __ATOMIC_RELAXED);
+    size_t bytes = tree_bytes(t);
+
+    if (json) {
+        fprintf(f, "{\"seconds\":%.3f,\"treeNodes\":%lu,\"treeBytes\":%zu,", seconds, nodes, bytes);
+        stats_json(f, &total, totalIdle);
+        fprintf(f, ",\"workers\":[");
+        for (int i = 0; i < n; i++) {
+            fprintf(f, "%s{", i ? "," : "");
+            stats_json(f, &each[i], idle[i]);
+            fprintf(f, "}");
+        }
+        fprintf(f, "]}\n");
+    } else {
+        fprintf(f, "%.2f s: %.0f iterations/sec, %.0f playouts/sec\n", seconds,
+                total.iterations / seconds, total.playouts / seconds);
+        fprintf(f, "Tree: %lu nodes, %.1f MiB, %lu reached for the first time\n", nodes, bytes / 1048576.0, total.newNodes);
+        fprintf(f, "%-7s %11s %11s %7s %7s %7s %8s %8s %8s %8s\n", "Worker", "Iterations", "Playouts", "Plies",
+                "Depth", "Max", "Select%", "Playout%", "Backup%", "Idle%");
+        for (int i = 0; i < n; i++) {
+            char name[16];
+            snprintf(name, sizeof(name), "%d", i);
+            stats_row(f, name, &each[i], idle[i]);
+        }
+        stats_row(f, "Total", &total, totalIdle);
+    }
+    fflush(f);
+}
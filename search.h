@@ -0,0 +1,64 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "board.h"
+#include "playout.h"
+#include "pool.h"
+#include "tree.h"
+
+// ===========================================================================
+// Monte Carlo tree search
+// Iterations of selection, expansion, playout and backpropagation on a shared tree.
+// Any number of threads may run them on the same tree at once.
+// ===========================================================================
+// Counters each worker keeps for itself, which other threads may read while it searches.
+struct SearchStats {
+    uint64_t iterations;
+    uint64_t playouts;
+    uint64_t plies;    // Played in playouts
+    uint64_t newNodes; // Iterations that reached a position for the first time
+    uint64_t depth;    // Selection depth, summed over iterations
+    uint64_t maxDepth;
+    // Time spent in each phase of an iteration
+    uint64_t selectNs, playoutNs, backpropNs;
+};
+
+// Only the worker writes its counters, so a plain add published with a relaxed store will do.
+#define COUNTER_ADD(x, v) __atomic_store_n(&(x), (x) + (v), __ATOMIC_RELAXED)
+#define COUNTER_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+
+// What each thread running iterations keeps for itself
+struct Worker {
+    uint64_t rng; // See playout_seed()
+    struct SearchStats stats; // Since the search started
+    uint64_t idleBase; // pool_idle_ns() when the search started
+};
+
+// One iteration from the root of t, counting it in w.
+void mcts_iter(struct Tree* t, const struct PlayoutLimits* limits, struct Worker* w);
+
+// Zeroes the counters of the n workers of pool, before a search.
+void stats_reset(struct Worker* workers, int n, const struct Pool* pool);
+// Writes the counters of the n workers of pool, summed and each, with the size of the tree.
+// seconds is how long the search has been running. As one line of JSON if json is set,
+// otherwise as a table to read.
+void stats_report(FILE* f, uint8_t json, struct Tree* t, const struct Worker* workers, int n,
+        const struct Pool* pool, double seconds);
+
+// Statistics of one of the root's moves, from the point of view of the player to move at the root.
+struct MoveStats {
+    uint32_t visits;
+    uint32_t wins, losses;
+    double advantage; // (wins - losses) / visits, NaN if unvisited
+};
+
+// Reads the statistics of the root's move i, which may still be changing. The root must be expanded.
+void root_move_stats(const struct Tree* t, uint8_t i, struct MoveStats* ms);
+// Index of the most visited of c's moves, or -1 if none has been visited. The move played from a search.
+// Safe to call while it is still running.
+int most_visited(const struct Children* c);
+
+#endif // SEARCH_H
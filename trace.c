@@ -0,0 +1,99 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include <err.h>
+#include <x86intrin.h>
+
+#include "trace.h"
+
+#define RING_SIZE (1 << TRACE_RING_BITS)
+#define RING_MASK (RING_SIZE - 1)
+
+static const char* eventNames[TRACE_EVENTS] = {"select", "expand", "playout", "backprop", "task", "park"};
+
+// Time stamp counter ticks, converted to time when written out
+struct TraceRecord {
+    uint64_t tsc;
+    uint32_t event;
+    uint32_t begin;
+};
+
+// Only its thread writes a ring; the writer publishes each record by moving head past it.
+struct TraceRing {
+    struct TraceRing* next;
+    int tid;
+    uint64_t head; // Records written, ever
+    struct TraceRecord records[RING_SIZE];
+};
+
+// Every thread's ring, newest first. Rings outlive their threads, for the dump.
+static struct TraceRing* rings;
+static int nextTid;
+static __thread struct TraceRing* ring;
+
+// The start of the timeline, by both clocks, to convert ticks to time
+static uint64_t baseTsc, baseNs;
+
+static uint64_t now_ns(void) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+void trace_init(void) {
+    baseNs = now_ns();
+    baseTsc = __rdtsc();
+}
+
+static struct TraceRing* register_thread(void) {
+    struct TraceRing* r = calloc(1, sizeof(struct TraceRing));
+    if (r == NULL)
+        err(1, "calloc(): Cannot allocate trace buffer");
+    r->tid = __atomic_fetch_add(&nextTid, 1, __ATOMIC_RELAXED);
+    r->next = __atomic_load_n(&rings, __ATOMIC_RELAXED);
+    while (!__atomic_compare_exchange_n(&rings, &r->next, r, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        ;
+    ring = r;
+    return r;
+}
+
+void trace_record(uint8_t event, uint8_t begin) {
+    struct TraceRing* r = ring ? ring : register_thread();
+    uint64_t head = r->head;
+    struct TraceRecord* record = &r->records[head & RING_MASK];
+    record->tsc = __rdtsc();
+    record->event = event;
+    record->begin = begin;
+    __atomic_store_n(&r->head, head + 1, __ATOMIC_RELEASE);
+}
+
+uint8_t trace_dump(const char* filename) {
+    FILE* f = fopen(filename, "w");
+    if (f == NULL) {
+        warn("fopen(): Cannot write trace to %s", filename);
+        return 0;
+    }
+    uint64_t nowTsc = __rdtsc();
+    double nsPerTick = (double)(now_ns() - baseNs) / (nowTsc - baseTsc);
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    uint8_t first = 1;
+    for (struct TraceRing* r = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); r != NULL; r = r->next) {
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"Thread %d\"}}",
+                first ? "" : ",\n", r->tid, r->tid);
+        first = 0;
+        uint64_t head = __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+        for (uint64_t i = head > RING_SIZE ? head - RING_SIZE : 0; i < head; i++) {
+            const struct TraceRecord* record = &r->records[i & RING_MASK];
+            if (record->event >= TRACE_EVENTS)
+                continue;
+            double us = (int64_t)(record->tsc - baseTsc) * nsPerTick / 1e3;
+            fprintf(f, ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%d}",
+                    eventNames[record->event], record->begin ? 'B' : 'E', us, r->tid);
+        }
+    }
+    fprintf(f, "\n]}\n");
+    fclose(f);
+    return 1;
+}
@@ -0,0 +1,43 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+// ===========================================================================
+// Tracing
+// Each thread records timestamped begin and end events in a ring buffer of its own, without locks,
+// to be written out as a Chrome trace (chrome://tracing, or ui.perfetto.dev) on demand.
+// Compiled in with `make TRACE=1`; otherwise the macros below are empty and cost nothing.
+// ===========================================================================
+// Events kept per thread, as a power of two. Older ones are overwritten.
+#define TRACE_RING_BITS (16)
+
+enum TraceEvent {
+    TRACE_SELECT,
+    TRACE_EXPAND,
+    TRACE_PLAYOUT,
+    TRACE_BACKPROP,
+    TRACE_TASK,  // A pool task running
+    TRACE_PARK,  // A pool worker waiting for tasks
+    TRACE_EVENTS
+};
+
+#ifdef TRACE
+// Notes the start of the timeline. Must be called once before any event is recorded.
+void trace_init(void);
+// Records the calling thread entering (begin set) or leaving an event.
+void trace_record(uint8_t event, uint8_t begin);
+// Writes every thread's events, as far back as their rings go, to filename. Returns 0 on failure.
+// Events recorded while it runs may be cut off or garbled.
+uint8_t trace_dump(const char* filename);
+
+#define TRACE_INIT() trace_init()
+#define TRACE_BEGIN(event) trace_record((event), 1)
+#define TRACE_END(event) trace_record((event), 0)
+#else
+#define TRACE_INIT()
+#define TRACE_BEGIN(event)
+#define TRACE_END(event)
+#endif // TRACE
+
+#endif // TRACE_H
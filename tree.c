@@ -0,0 +1,632 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <err.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "tree.h"
+#include "trace.h"
+
+// Arena elements: a node takes two, and a block of successors its header and ten bytes per move.
+#define UNIT_BYTES (16)
+#define NODE_ELEMS (2)
+#define CHILDREN_HEADER_BYTES (24)
+#define CHILDREN_ELEMS(n) ((CHILDREN_HEADER_BYTES + (n) * (sizeof(struct Node*) + sizeof(uint16_t)) + UNIT_BYTES - 1) / UNIT_BYTES)
+
+// Probes before giving up on a full table.
+#define MAX_PROBES (32)
+
+#define TABLE_BYTES(t) (((t)->tableMask + 1) * sizeof(struct Node*))
+// A table holding fewer nodes than this share of its slots is cleared slot by slot rather than whole.
+#define SPARSE_TABLE_SHARE (64)
+
+// Shared by every node at the end of a game.
+static struct Children noChildren = {.n = 0};
+
+// Initial game state
+extern const struct State initialState;
+
+static void seed_node(const struct Tree* t, struct Node* node);
+static void unmap_seeds(struct Tree* t);
+
+static void* alloc_elems(struct Tree* t, size_t n) {
+    pthread_spin_lock(&t->arenaLock);
+    void* block = arena_alloc(&t->arena, n);
+    pthread_spin_unlock(&t->arenaLock);
+    return block;
+}
+
+static void free_elems(struct Tree* t, void* block, size_t n) {
+    pthread_spin_lock(&t->arenaLock);
+    arena_free(&t->arena, block, n);
+    pthread_spin_unlock(&t->arenaLock);
+}
+
+// Empties the slots of node and of every node it leads to.
+static void unlink_reachable(struct Tree* t, struct Node* node) {
+    if (node == NULL || node->mark == t->mark)
+        return;
+    node->mark = t->mark;
+    for (uint64_t i = 0; i < MAX_PROBES; i++) {
+        struct Node** slot = &t->table[(node->key + i) & t->tableMask];
+        if (*slot == node) {
+            *slot = NULL;
+            break;
+        }
+    }
+    struct Children* c = node->children;
+    if (c == NULL)
+        return;
+    for (uint8_t i = 0; i < c->n; i++)
+        unlink_reachable(t, c->node[i]);
+}
+
+// Frees every node and starts again from root. After a short search, such as each of a batch's,
+// only the slots in use are cleared: they are all reachable from the root, as every node is added
+// as some node's successor and collect_garbage() drops those no longer reachable.
+static void clear_nodes(struct Tree* t, const struct State* root) {
+    if (t->rootNode && t->nodes < (t->tableMask + 1) / SPARSE_TABLE_SHARE) {
+        t->mark++;
+        unlink_reachable(t, t->rootNode);
+    } else {
+        memset(t->table, 0, (t->tableMask + 1) * sizeof(struct Node*));
+    }
+    arena_reset(&t->arena);
+    t->nodes = 0;
+    memcpy(&t->root, root, sizeof(struct State));
+    refresh_state(&t->root);
+    t->rootNode = tree_find(t, t->root.key);
+}
+
+void tree_init(struct Tree* t, const struct State* root) {
+    arena_init(&t->arena, UNIT_BYTES, 1);
+    pthread_spin_init(&t->arenaLock, PTHREAD_PROCESS_PRIVATE);
+    t->tableMask = (1ULL << TREE_TABLE_BITS) - 1;
+    t->table = malloc((t->tableMask + 1) * sizeof(struct Node*));
+    if (t->table == NULL)
+        err(1, "malloc(): Cannot allocate transposition table");
+    t->rootNode = NULL;
+    t->mark = 0;
+    t->historyLen = 0;
+    t->byteLimit = 0;
+    t->seeds = NULL;
+    t->nSeeds = 0;
+    t->kept = NULL;
+    t->nKept = 0;
+    clear_nodes(t, root);
+}
+
+void tree_reset(struct Tree* t, const struct State* root) {
+    t->historyLen = 0;
+    clear_nodes(t, root);
+}
+
+void tree_destroy(struct Tree* t) {
+    arena_destroy(&t->arena);
+    pthread_spin_destroy(&t->arenaLock);
+    free(t->table);
+    t->table = NULL;
+    t->rootNode = NULL;
+    unmap_seeds(t);
+    free(t->kept);
+    t->kept = NULL;
+    t->nKept = 0;
+}
+
+size_t tree_bytes(struct Tree* t) {
+    return __atomic_load_n(&t->arena.bytesCarved, __ATOMIC_RELAXED) + TABLE_BYTES(t);
+}
+
+void tree_set_limit(struct Tree* t, size_t bytes) {
+    if (bytes && bytes < 2 * TABLE_BYTES(t))
+        bytes = 2 * TABLE_BYTES(t);
+    t->byteLimit = bytes;
+}
+
+uint8_t tree_full(const struct Tree* t) {
+    if (t->byteLimit == 0)
+        return 0;
+    // Without the arena lock, so the search threads do not queue on it.
+    return __atomic_load_n(&t->arena.bytesCarved, __ATOMIC_RELAXED) + TABLE_BYTES(t) >= t->byteLimit;
+}
+
+void tree_set_history(struct Tree* t, const uint64_t* keys, int n) {
+    if (n > FIFTY_MOVE_PLIES) {
+        // Too old to repeat
+        keys += n - FIFTY_MOVE_PLIES;
+        n = FIFTY_MOVE_PLIES;
+    }
+    memcpy(t->history, keys, n * sizeof(uint64_t));
+    t->historyLen = n;
+}
+
+// Places an existing node in the table. Only while no search is running.
+static uint8_t insert_node(struct Tree* t, struct Node* node) {
+    for (uint64_t i = 0; i < MAX_PROBES; i++) {
+        struct Node** slot = &t->table[(node->key + i) & t->tableMask];
+        if (*slot == NULL) {
+            *slot = node;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+struct Node* tree_find(struct Tree* t, uint64_t key) {
+    struct Node* fresh = NULL;
+    for (uint64_t i = 0; i < MAX_PROBES; i++) {
+        struct Node** slot = &t->table[(key + i) & t->tableMask];
+        struct Node* node = __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+        if (node == NULL) {
+            // Claim the empty slot. If another node got there first, look at it instead.
+            if (fresh == NULL) {
+                fresh = alloc_elems(t, NODE_ELEMS);
+                memset(fresh, 0, sizeof(struct Node));
+                fresh->key = key;
+                seed_node(t, fresh);
+            }
+            if (__atomic_compare_exchange_n(slot, &node, fresh, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+                __atomic_fetch_add(&t->nodes, 1, __ATOMIC_RELAXED);
+                return fresh;
+            }
+        }
+        if (node->key == key) {
+            if (fresh)
+                free_elems(t, fresh, NODE_ELEMS);
+            return node;
+        }
+    }
+    if (fresh)
+        free_elems(t, fresh, NODE_ELEMS);
+    return NULL;
+}
+
+// Makes c the successors of node, unless another thread got there first. Returns the ones that won.
+static struct Children* publish_children(struct Tree* t, struct Node* node, struct Children* c) {
+    struct Children* existing = NULL;
+    if (__atomic_compare_exchange_n(&node->children, &existing, c, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+        return c;
+    if (c != &noChildren)
+        free_elems(t, c, CHILDREN_ELEMS(c->n));
+    return existing;
+}
+
+struct Children* tree_expand(struct Tree* t, struct Node* node, const struct State* s) {
+    struct Children* existing = __atomic_load_n(&node->children, __ATOMIC_ACQUIRE);
+    if (existing)
+        return existing;
+
+    TRACE_BEGIN(TRACE_EXPAND);
+    struct Move moves[MAX_MOVES];
+    uint8_t n = generate_moves(s, moves);
+    if (n == 0) {
+        TRACE_END(TRACE_EXPAND);
+        return publish_children(t, node, &noChildren);
+    }
+
+    // Header, then each array in order of alignment.
+    uint8_t* block = alloc_elems(t, CHILDREN_ELEMS(n));
+    struct Children* c = (struct Children*)block;
+    block += CHILDREN_HEADER_BYTES;
+    c->n = n;
+    c->node = (struct Node**)block;
+    block += n * sizeof(struct Node*);
+    c->move = (uint16_t*)block;
+
+    memset(c->node, 0, n * sizeof(struct Node*));
+    for (uint8_t i = 0; i < n; i++)
+        c->move[i] = pack_move(&moves[i]);
+
+    TRACE_END(TRACE_EXPAND);
+    return publish_children(t, node, c);
+}
+
+static void mark_reachable(struct Tree* t, struct Node* node) {
+    if (node == NULL || node->mark == t->mark)
+        return;
+    node->mark = t->mark;
+    struct Children* c = node->children;
+    if (c == NULL)
+        return;
+    for (uint8_t i = 0; i < c->n; i++)
+        mark_reachable(t, c->node[i]);
+}
+
+// Frees every node not reachable from the root, then rebuilds the table from the rest,
+// as emptied slots would otherwise cut the probe sequences of the nodes after them.
+static void collect_garbage(struct Tree* t) {
+    t->mark++;
+    mark_reachable(t, t->rootNode);
+
+    uint64_t nKept = 0;
+    for (uint64_t i = 0; i <= t->tableMask; i++) {
+        struct Node* node = t->table[i];
+        if (node == NULL)
+            continue;
+        if (node->mark == t->mark) {
+            t->table[nKept++] = node;
+        } else {
+            if (node->children && node->children != &noChildren)
+                arena_free(&t->arena, node->children, CHILDREN_ELEMS(node->children->n));
+            arena_free(&t->arena, node, NODE_ELEMS);
+        }
+    }
+    // Survivors are packed at the front of the table; move them to their home slots.
+    struct Node** kept = malloc(nKept * sizeof(struct Node*));
+    if (kept == NULL)
+        err(1, "malloc(): Cannot rebuild transposition table");
+    memcpy(kept, t->table, nKept * sizeof(struct Node*));
+    memset(t->table, 0, (t->tableMask + 1) * sizeof(struct Node*));
+    t->nodes = 0;
+    for (uint64_t i = 0; i < nKept; i++) {
+        if (insert_node(t, kept[i]))
+            t->nodes++;
+        else
+            warnx("Transposition table full: dropped a node");
+    }
+    free(kept);
+}
+
+// A node's visits, and the bytes it holds along with its successors.
+struct NodeCost {
+    uint32_t visits;
+    uint32_t bytes;
+};
+
+static int most_visited_first(const void* a, const void* b) {
+    uint32_t va = ((const struct NodeCost*)a)->visits, vb = ((const struct NodeCost*)b)->visits;
+    return (va < vb) - (va > vb);
+}
+
+// Cuts the successors of the least visited nodes until what is left in use fits in target bytes.
+static void cut_least_visited(struct Tree* t, size_t target) {
+    if (t->arena.bytesInUse + TABLE_BYTES(t) <= target)
+        return;
+
+    // Keep the most visited nodes' successors, as many as fit, and cut below the rest.
+    struct NodeCost* costs = malloc(t->nodes * sizeof(struct NodeCost));
+    if (costs == NULL)
+        err(1, "malloc(): Cannot rank nodes to prune");
+    uint64_t n = 0;
+    for (uint64_t i = 0; i <= t->tableMask && n < t->nodes; i++) {
+        struct Node* node = t->table[i];
+        if (node == NULL)
+            continue;
+        costs[n].visits = node->visits;
+        costs[n].bytes = NODE_ELEMS * UNIT_BYTES;
+        if (node->children && node->children != &noChildren)
+            costs[n].bytes += CHILDREN_ELEMS(node->children->n) * UNIT_BYTES;
+        n++;
+    }
+    qsort(costs, n, sizeof(struct NodeCost), most_visited_first);
+    size_t kept = TABLE_BYTES(t);
+    uint64_t k = 0;
+    while (k < n && kept + costs[k].bytes <= target)
+        kept += costs[k++].bytes;
+    uint32_t threshold = k < n ? costs[k].visits : 0;
+    free(costs);
+    if (k == n)
+        return;
+
+    for (uint64_t i = 0; i <= t->tableMask; i++) {
+        struct Node* node = t->table[i];
+        if (node == NULL || node == t->rootNode || node->visits > threshold)
+            continue;
+        if (node->children && node->children != &noChildren) {
+            arena_free(&t->arena, node->children, CHILDREN_ELEMS(node->children->n));
+            node->children = NULL;
+        }
+    }
+    collect_garbage(t);
+}
+
+// The node in the table with the given key, if any.
+static struct Node* lookup_node(const struct Tree* t, uint64_t key) {
+    for (uint64_t i = 0; i < MAX_PROBES; i++) {
+        struct Node* node = t->table[(key + i) & t->tableMask];
+        if (node == NULL || node->key == key)
+            return node;
+    }
+    return NULL;
+}
+
+// Copies the tree into a fresh arena, packed, and unmaps the old one, which freed blocks have left full of holes.
+// Every node is in the table, and a node's successors only lead to nodes in it.
+static void compact(struct Tree* t) {
+    struct Arena old = t->arena;
+    arena_init(&t->arena, UNIT_BYTES, old.hugePages);
+
+    // Nodes first, so their new addresses are in the table by the time the successors are copied.
+    for (uint64_t i = 0; i <= t->tableMask; i++) {
+        struct Node* node = t->table[i];
+        if (node == NULL)
+            continue;
+        t->table[i] = arena_alloc(&t->arena, NODE_ELEMS);
+        memcpy(t->table[i], node, sizeof(struct Node));
+    }
+    for (uint64_t i = 0; i <= t->tableMask; i++) {
+        struct Node* node = t->table[i];
+        if (node == NULL || node->children == NULL || node->children == &noChildren)
+            continue;
+        struct Children* c = node->children;
+        size_t elems = CHILDREN_ELEMS(c->n);
+        uint8_t* block = arena_alloc(&t->arena, elems);
+        memcpy(block, c, elems * UNIT_BYTES);
+        struct Children* moved = (struct Children*)block;
+        moved->node = (struct Node**)(block + ((uint8_t*)c->node - (uint8_t*)c));
+        moved->move = (uint16_t*)(block + ((uint8_t*)c->move - (uint8_t*)c));
+        for (uint8_t j = 0; j < c->n; j++)
+            if (c->node[j])
+                moved->node[j] = lookup_node(t, c->node[j]->key);
+        node->children = moved;
+    }
+    t->rootNode = lookup_node(t, t->rootNode->key);
+    arena_destroy(&old);
+}
+
+void tree_prune(struct Tree* t) {
+    size_t target = t->byteLimit / 100 * TREE_PRUNE_PERCENT;
+    if (t->byteLimit == 0 || tree_bytes(t) <= target)
+        return;
+    cut_least_visited(t, target);
+    compact(t);
+}
+
+void tree_advance(struct Tree* t, uint8_t i) {
+    struct Children* c = t->rootNode->children;
+    struct Node* next = c->node[i];
+    struct Move m;
+    struct Undo u;
+    unpack_move(&t->root, c->move[i], &m);
+    if (t->historyLen == FIFTY_MOVE_PLIES) {
+        // Too old to repeat
+        memmove(t->history, t->history + 1, (FIFTY_MOVE_PLIES - 1) * sizeof(uint64_t));
+        t->historyLen--;
+    }
+    t->history[t->historyLen++] = t->root.key;
+    make_move(&t->root, &m, &u);
+
+    if (next == NULL) {
+        // Nothing was searched below the move.
+        struct State root;
+        memcpy(&root, &t->root, sizeof(struct State));
+        clear_nodes(t, &root);
+        return;
+    }
+    t->rootNode = next;
+    collect_garbage(t);
+}
+
+// ===========================================================================
+// Saved statistics
+// A header, then the nodes sorted by key so a position is found by binary search in the mapped file.
+// ===========================================================================
+#define SAVED_MAGIC "BORISTRE"
+#define SAVED_VERSION (1)
+
+struct SavedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t nodeBytes;
+    uint64_t startKey; // Of the initial position: differs if the hashing or the byte order does
+    uint64_t n;
+};
+
+static uint64_t start_key(void) {
+    struct State s;
+    memcpy(&s, &initialState, sizeof(struct State));
+    refresh_state(&s);
+    return s.key;
+}
+
+static const struct SavedNode* find_saved(const struct SavedNode* saved, uint64_t n, uint64_t key) {
+    uint64_t lo = 0, hi = n;
+    while (lo < hi) {
+        uint64_t mid = lo + (hi - lo) / 2;
+        if (saved[mid].key < key)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo < n && saved[lo].key == key ? &saved[lo] : NULL;
+}
+
+static void seed_node(const struct Tree* t, struct Node* node) {
+    const struct SavedNode* saved = find_saved(t->kept, t->nKept, node->key);
+    if (saved == NULL)
+        saved = find_saved(t->seeds, t->nSeeds, node->key);
+    if (saved) {
+        node->visits = saved->visits;
+        node->winsW = saved->winsW;
+        node->winsB = saved->winsB;
+    }
+}
+
+static void unmap_seeds(struct Tree* t) {
+    if (t->seeds)
+        munmap((struct SavedHeader*)t->seeds - 1, t->seedBytes);
+    t->seeds = NULL;
+    t->nSeeds = 0;
+}
+
+static int by_key(const void* a, const void* b) {
+    uint64_t ka = ((const struct SavedNode*)a)->key, kb = ((const struct SavedNode*)b)->key;
+    return (ka > kb) - (ka < kb);
+}
+
+static int by_visits_descending(const void* a, const void* b) {
+    uint32_t va = ((const struct SavedNode*)a)->visits, vb = ((const struct SavedNode*)b)->visits;
+    return (va < vb) - (va > vb);
+}
+
+static void append_saved(const struct Node* node, struct SavedNode** out, uint64_t* n, uint64_t* size) {
+    if (*n == *size) {
+        *size = *size ? 2 * *size : 1024;
+        *out = realloc(*out, *size * sizeof(struct SavedNode));
+        if (*out == NULL)
+            err(1, "realloc(): Cannot collect nodes to save");
+    }
+    (*out)[(*n)++] = (struct SavedNode){.key = node->key, .visits = node->visits, .winsW = node->winsW,
+            .winsB = node->winsB};
+}
+
+// Appends the visited nodes within depth plies of the root, each once.
+// Breadth first, so a transposition is reached first by its shortest line and keeps all the depth left below it.
+static void collect_saved(struct Tree* t, int depth, struct SavedNode** out, uint64_t* n, uint64_t* size) {
+    if (t->rootNode->visits == 0)
+        return;
+    uint64_t queued = 1, queueSize = 1024;
+    struct Node** queue = malloc(queueSize * sizeof(struct Node*));
+    if (queue == NULL)
+        err(1, "malloc(): Cannot collect nodes to save");
+    t->mark++;
+    t->rootNode->mark = t->mark;
+    queue[0] = t->rootNode;
+    // [begin, end) of the queue is one ply.
+    for (uint64_t begin = 0, end = 1; begin < end; begin = end, end = queued, depth--) {
+        for (uint64_t q = begin; q < end; q++) {
+            append_saved(queue[q], out, n, size);
+            struct Children* c = queue[q]->children;
+            if (depth == 0 || c == NULL)
+                continue;
+            for (uint8_t i = 0; i < c->n; i++) {
+                struct Node* child = c->node[i];
+                if (child == NULL || child->visits == 0 || child->mark == t->mark)
+                    continue;
+                child->mark = t->mark;
+                if (queued == queueSize) {
+                    queueSize *= 2;
+                    queue = realloc(queue, queueSize * sizeof(struct Node*));
+                    if (queue == NULL)
+                        err(1, "realloc(): Cannot collect nodes to save");
+                }
+                queue[queued++] = child;
+            }
+        }
+    }
+    free(queue);
+}
+
+// Merges a and b, both sorted by key, into a new array sorted by key, of *n nodes.
+// Where both have a position, a's statistics are taken: they are the newer, and already include b's.
+static struct SavedNode* merge_saved(const struct SavedNode* a, uint64_t na, const struct SavedNode* b, uint64_t nb,
+        uint64_t* n) {
+    struct SavedNode* out = malloc((na + nb + 1) * sizeof(struct SavedNode));
+    if (out == NULL)
+        err(1, "malloc(): Cannot collect nodes to save");
+    uint64_t i = 0, j = 0;
+    *n = 0;
+    while (i < na || j < nb) {
+        if (j == nb || (i < na && a[i].key <= b[j].key)) {
+            if (j < nb && a[i].key == b[j].key)
+                j++;
+            out[(*n)++] = a[i++];
+        } else {
+            out[(*n)++] = b[j++];
+        }
+    }
+    return out;
+}
+
+// Drops all but the TREE_SAVE_MAX_NODES most visited, leaving the rest sorted by key.
+static void cap_saved(struct SavedNode* nodes, uint64_t* n) {
+    if (*n <= TREE_SAVE_MAX_NODES)
+        return;
+    qsort(nodes, *n, sizeof(struct SavedNode), by_visits_descending);
+    *n = TREE_SAVE_MAX_NODES;
+    qsort(nodes, *n, sizeof(struct SavedNode), by_key);
+}
+
+// The nodes within depth plies of the root, merged into those gathered from earlier roots.
+static struct SavedNode* merge_tree(struct Tree* t, int depth, uint64_t* n) {
+    struct SavedNode* nodes = NULL;
+    uint64_t nTree = 0, size = 0;
+    collect_saved(t, depth, &nodes, &nTree, &size);
+    qsort(nodes, nTree, sizeof(struct SavedNode), by_key);
+    struct SavedNode* merged = merge_saved(nodes, nTree, t->kept, t->nKept, n);
+    free(nodes);
+    return merged;
+}
+
+void tree_keep(struct Tree* t, int depth) {
+    uint64_t n;
+    struct SavedNode* merged = merge_tree(t, depth, &n);
+    cap_saved(merged, &n);
+    free(t->kept);
+    t->kept = merged;
+    t->nKept = n;
+}
+
+uint8_t tree_save(struct Tree* t, const char* path, int depth) {
+    // Keep what the tree has not reached this time. Where it has, its statistics already include the saved ones.
+    uint64_t nTree, n;
+    struct SavedNode* tree = merge_tree(t, depth, &nTree);
+    struct SavedNode* nodes = merge_saved(tree, nTree, t->seeds, t->nSeeds, &n);
+    free(tree);
+    cap_saved(nodes, &n);
+
+    // Written aside and renamed over, so neither readers nor a crash see half a file.
+    char tmp[4096];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    FILE* f = fopen(tmp, "wb");
+    if (f == NULL) {
+        warn("fopen(): Cannot save search tree to %s", tmp);
+        free(nodes);
+        return 0;
+    }
+    struct SavedHeader header = {.magic = SAVED_MAGIC, .version = SAVED_VERSION, .nodeBytes = sizeof(struct SavedNode),
+            .startKey = start_key(), .n = n};
+    uint8_t ok = fwrite(&header, sizeof(header), 1, f) == 1 && fwrite(nodes, sizeof(struct SavedNode), n, f) == n;
+    ok = fclose(f) == 0 && ok;
+    free(nodes);
+    if (!ok || rename(tmp, path) < 0) {
+        warn("Cannot save search tree to %s", path);
+        unlink(tmp);
+        return 0;
+    }
+    return 1;
+}
+
+uint8_t tree_seed(struct Tree* t, const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        warn("open(): Cannot read search tree %s", path);
+        return 0;
+    }
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct SavedHeader)) {
+        warnx("%s: Not a saved search tree", path);
+        close(fd);
+        return 0;
+    }
+    void* map = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        warn("mmap(): Cannot read search tree %s", path);
+        return 0;
+    }
+    const struct SavedHeader* header = map;
+    if (memcmp(header->magic, SAVED_MAGIC, sizeof(header->magic)) != 0 || header->version != SAVED_VERSION
+            || header->nodeBytes != sizeof(struct SavedNode) || header->startKey != start_key()
+            || header->n > (st.st_size - sizeof(struct SavedHeader)) / sizeof(struct SavedNode)) {
+        warnx("%s: Not a saved search tree, or from another build", path);
+        munmap(map, st.st_size);
+        return 0;
+    }
+
+    unmap_seeds(t);
+    free(t->kept);
+    t->kept = NULL;
+    t->nKept = 0;
+    t->seeds = (const struct SavedNode*)(header + 1);
+    t->nSeeds = header->n;
+    t->seedBytes = st.st_size;
+    if (t->rootNode->visits == 0)
+        seed_node(t, t->rootNode);
+    return 1;
+}
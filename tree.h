@@ -0,0 +1,125 @@
+#ifndef TREE_H
+#define TREE_H
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include "arena.h"
+#include "board.h"
+
+// ===========================================================================
+// Search graph
+// Each position searched has one node, found by its Zobrist key in a transposition table,
+// so lines that transpose into each other share their statistics and successors.
+// A node's successors are one arena block: the packed moves, and the node each leads to.
+// Positions are recomputed by playing the moves down from the root.
+// ===========================================================================
+struct Node {
+    uint64_t key;
+    uint32_t visits;             // Games played out through this position
+    uint32_t winsW;              // Of which White won
+    uint32_t winsB;              // Of which Black won
+    uint32_t mark;               // Last collection that found it reachable
+    struct Children* children;   // NULL until it is expanded
+};
+
+struct Children {
+    uint8_t n;
+    struct Node** node; // NULL until that move is first searched
+    uint16_t* move;     // Packed with pack_move()
+};
+
+struct Tree {
+    struct State root;
+    struct Node* rootNode;
+    // Keys of the game's positions before the root, oldest first, as far back as one could still repeat.
+    uint64_t history[FIFTY_MOVE_PLIES];
+    uint8_t historyLen;
+    struct Arena arena;
+    pthread_spinlock_t arenaLock; // Held only around arena calls, so threads can expand concurrently
+
+    // Transposition table: open addressing on the key, slots claimed with compare-and-swap.
+    struct Node** table;
+    uint64_t tableMask;
+    uint64_t nodes; // In the table
+    uint32_t mark;
+
+    size_t byteLimit; // What tree_bytes() may reach, 0 for no limit. Set with tree_set_limit().
+
+    // Statistics from a file mapped by tree_seed(), sorted by key, that new nodes start from
+    const struct SavedNode* seeds;
+    uint64_t nSeeds;
+    size_t seedBytes; // Of the mapping
+    // Statistics gathered by tree_keep() from near roots since moved past, sorted by key. Newer than the seeds.
+    struct SavedNode* kept;
+    uint64_t nKept;
+};
+
+// A node's statistics as saved by tree_save(), in the host's byte order so the file can be mapped as it is.
+struct SavedNode {
+    uint64_t key;
+    uint32_t visits;
+    uint32_t winsW;
+    uint32_t winsB;
+    uint32_t pad;
+};
+
+// Search threads share the statistics; only the counts need to be exact, not their order.
+#define STAT_LOAD(x) __atomic_load_n(&(x), __ATOMIC_RELAXED)
+#define STAT_ADD(x, v) __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+#define STAT_SUB(x, v) __atomic_fetch_sub(&(x), (v), __ATOMIC_RELAXED)
+
+// Slots in the transposition table, as a power of two.
+#define TREE_TABLE_BITS (21)
+// Plies below the root whose nodes tree_save() writes out
+#define TREE_SAVE_DEPTH (4)
+// Most nodes a saved file keeps, the most visited first
+#define TREE_SAVE_MAX_NODES (1 << 20)
+// Share of its byte limit that tree_prune() cuts a tree back to, leaving room for the next search to grow.
+#define TREE_PRUNE_PERCENT (75)
+
+void tree_init(struct Tree* t, const struct State* root);
+// Starts a new game from the root position, freeing the whole tree at once.
+void tree_reset(struct Tree* t, const struct State* root);
+void tree_destroy(struct Tree* t);
+// Bytes the tree holds: the table, and what its arena has handed out, including freed blocks not yet reused, as they
+// stay mapped until tree_prune() compacts the tree. Safe to call during a search.
+size_t tree_bytes(struct Tree* t);
+// Limits the bytes the tree may hold, table included, or lifts the limit given 0.
+// A limit leaving less than the table's own size again for the nodes is raised to that. No search may be running.
+void tree_set_limit(struct Tree* t, size_t bytes);
+// Whether the tree has reached its byte limit. Searches then stop adding to it and play out from its leaves
+// for the rest of the search: only tree_prune(), between searches, makes room again.
+// Cheap enough to call on every iteration; the count may be a block or two behind.
+uint8_t tree_full(const struct Tree* t);
+// Cuts a tree over TREE_PRUNE_PERCENT of its byte limit back under it: the least visited nodes lose their successors,
+// keeping their own statistics, and whatever only they reached is freed. The rest is then copied into fresh chunks and
+// the old ones unmapped, so for a moment the tree holds up to its limit again on top. No search may be running.
+void tree_prune(struct Tree* t);
+// Saves the statistics of the nodes within depth plies of the root to path, along with those gathered by tree_keep()
+// and those of any other positions in the file mapped by tree_seed(), so what is learnt builds up across runs.
+// Returns 0 on failure.
+// The file is replaced whole, and a mapping of the old one stays valid. No search may be running.
+uint8_t tree_save(struct Tree* t, const char* path, int depth);
+// Gathers the statistics of the nodes within depth plies of the root for tree_save(), which would otherwise only
+// see those of the last root. Call before tree_advance() or tree_reset() frees them. No search may be running.
+void tree_keep(struct Tree* t, int depth);
+// Maps a file written by tree_save(). The root, if not yet visited, and every position added to the tree from then on
+// start with the statistics saved for them, wherever the game reached them from. Those gathered by tree_keep() are
+// dropped, as the file is taken to hold them. Returns 0 on failure. No search may be running.
+uint8_t tree_seed(struct Tree* t, const char* path);
+// Sets the keys of the game's positions before the root, oldest first. Only the last FIFTY_MOVE_PLIES are kept.
+void tree_set_history(struct Tree* t, const uint64_t* keys, int n);
+
+// Returns the node of the position with this key, adding it if it is new.
+// Returns NULL if the table is too full to add it. Safe to call from several search threads.
+struct Node* tree_find(struct Tree* t, uint64_t key);
+// Returns the successors of node, whose position is s, expanding it first if needed.
+// A node at the end of a game has no successors (n is zero).
+// Threads racing to expand the same node agree on one block.
+struct Children* tree_expand(struct Tree* t, struct Node* node, const struct State* s);
+// Plays the root's move i, adding the root to the history. The nodes still reachable from the position after it are kept,
+// statistics intact, and the rest are freed. The root must already be expanded, and no search running.
+void tree_advance(struct Tree* t, uint8_t i);
+
+#endif // TREE_H
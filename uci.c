@@ -0,0 +1,634 @@
+#include <ctype.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <err.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "board.h"
+#include "book.h"
+#include "playout.h"
+#include "pool.h"
+#include "search.h"
+#include "trace.h"
+#include "tree.h"
+#include "uci.h"
+
+extern const struct State initialState;
+
+struct Uci {
+    int nthreads;
+    struct Pool pool;
+    struct Worker* workers;
+    struct Tree tree;
+
+    // The game as the GUI last gave it: the position it started from, and the moves played since, packed.
+    struct State base;
+    uint16_t* moves;
+    size_t nMoves;
+    // The game up to the tree's root. One that moves on from it keeps the tree below the new root.
+    uint64_t treeBaseKey;
+    uint16_t* treeMoves;
+    size_t treeLen;
+    // Where the tree's statistics are seeded from, and saved back to between games, if anywhere
+    char* treeFile;
+    // Opening book played from before searching, if one is set
+    struct Book book;
+    char* bookFile;
+
+    // The search
+    volatile int searching;
+    struct PlayoutLimits limits;
+    uint8_t stats; // Counters with every info line
+    uint64_t nodeLimit;   // Root visits, 0 for none
+    uint32_t startVisits; // Root visits carried over from earlier searches
+    struct PoolGroup group;
+    struct timespec start, deadline;
+    uint8_t hasDeadline;
+    // Searching the opponent's replies to the last move given, before the GUI says which one was played.
+    // The move time to use on ponderhit, and the node limit.
+    uint8_t pondering;
+    long ponderMs;
+    uint64_t ponderNodes;
+
+    // The monitor thread, which ends the search and replies for it
+    pthread_t monitor;
+    uint8_t monitorRunning;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;  // Stop requested
+    uint8_t stopRequested;
+};
+
+// ===========================================================================
+// Moves
+// ===========================================================================
+#define UCI_MOVE_LEN (6)
+
+// Coordinate notation, e.g. "e2e4", "e7e8q" and "e1g1" for castling, terminated.
+static void move_to_uci(const struct Move* m, char str[UCI_MOVE_LEN]) {
+    from_0x88_to_coord(m->orig, str);
+    from_0x88_to_coord(m->dest, str + 2);
+    str[4] = m->promoRole ? " prnbqk"[m->promoRole] : 0;
+    str[5] = 0;
+}
+
+// Finds the legal move in s written as token (of length n). Returns 0 if there is none.
+static uint8_t find_move(const struct State* s, const char* token, size_t n, struct Move* out) {
+    struct Move moves[MAX_MOVES];
+    uint8_t nMoves = generate_moves(s, moves);
+    for (uint8_t i = 0; i < nMoves; i++) {
+        char str[UCI_MOVE_LEN];
+        move_to_uci(&moves[i], str);
+        if (strlen(str) == n && strncasecmp(str, token, n) == 0) {
+            memcpy(out, &moves[i], sizeof(struct Move));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// ===========================================================================
+// Reporting
+// ===========================================================================
+static double ms_since(const struct timespec* start) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+// Follows the most visited moves down from the root, while the search may still be running.
+// Fills pv with them, space-separated, and returns how many there are.
+static int principal_variation(const struct Tree* t, char* pv, size_t size) {
+    struct State s;
+    memcpy(&s, &t->root, sizeof(struct State));
+    struct Node* node = t->rootNode;
+    int depth = 0;
+    pv[0] = 0;
+    while (node != NULL && depth < 64) {
+        struct Children* c = __atomic_load_n(&node->children, __ATOMIC_ACQUIRE);
+        if (c == NULL)
+            break;
+        int i = most_visited(c);
+        if (i < 0)
+            break;
+        struct Move m;
+        struct Undo u;
+        char str[UCI_MOVE_LEN];
+        unpack_move(&s, c->move[i], &m);
+        move_to_uci(&m, str);
+        size_t len = strlen(pv);
+        if (len + UCI_MOVE_LEN + 1 > size)
+            break;
+        snprintf(pv + len, size - len, "%s%s", depth ? " " : "", str);
+        make_move(&s, &m, &u);
+        node = __atomic_load_n(&c->node[i], __ATOMIC_ACQUIRE);
+        depth++;
+    }
+    return depth;
+}
+
+static void print_info(struct Uci* u) {
+    char pv[64 * UCI_MOVE_LEN];
+    int depth = principal_variation(&u->tree, pv, sizeof(pv));
+    uint32_t visits = STAT_LOAD(u->tree.rootNode->visits) - u->startVisits;
+    double ms = ms_since(&u->start);
+    printf("info depth %d nodes %u nps %.0f time %.0f", depth, visits, ms > 0 ? visits / ms * 1e3 : 0, ms);
+    if (u->tree.byteLimit)
+        printf(" hashfull %zu", tree_bytes(&u->tree) * 1000 / u->tree.byteLimit);
+    printf(" pv %s\n", pv);
+    if (u->stats) {
+        printf("info string stats ");
+        stats_report(stdout, 1, &u->tree, u->workers, u->nthreads, &u->pool, ms / 1e3);
+    }
+    fflush(stdout);
+}
+
+// The most visited root move, or the first one if none has been visited yet,
+// and the most visited reply to it as the move to ponder on, if any.
+static void print_bestmove(struct Uci* u) {
+    struct Children* c = __atomic_load_n(&u->tree.rootNode->children, __ATOMIC_ACQUIRE);
+    if (c == NULL || c->n == 0) {
+        printf("bestmove 0000\n");
+        fflush(stdout);
+        return;
+    }
+    int best = most_visited(c);
+    if (best < 0)
+        best = 0;
+    struct State s;
+    struct Move m;
+    struct Undo undo;
+    char str[UCI_MOVE_LEN];
+    memcpy(&s, &u->tree.root, sizeof(struct State));
+    unpack_move(&s, c->move[best], &m);
+    move_to_uci(&m, str);
+    printf("bestmove %s", str);
+
+    struct Node* child = __atomic_load_n(&c->node[best], __ATOMIC_ACQUIRE);
+    struct Children* replies = child ? __atomic_load_n(&child->children, __ATOMIC_ACQUIRE) : NULL;
+    int reply = replies ? most_visited(replies) : -1;
+    if (reply >= 0) {
+        make_move(&s, &m, &undo);
+        unpack_move(&s, replies->move[reply], &m);
+        move_to_uci(&m, str);
+        printf(" ponder %s", str);
+    }
+    printf("\n");
+    fflush(stdout);
+}
+
+// ===========================================================================
+// Searching
+// ===========================================================================
+static void request_stop(struct Uci* u) {
+    pthread_mutex_lock(&u->lock);
+    u->stopRequested = 1;
+    pthread_cond_signal(&u->wake);
+    pthread_mutex_unlock(&u->lock);
+}
+
+// Pool task: search until stopped or the node limit is reached.
+static void search_task(void* args) {
+    struct Uci* u = (struct Uci*)args;
+    struct Worker* w = &u->workers[pool_worker_index()];
+    while (u->searching) {
+        mcts_iter(&u->tree, &u->limits, w);
+        if (u->nodeLimit && STAT_LOAD(u->tree.rootNode->visits) - u->startVisits >= u->nodeLimit) {
+            u->searching = 0;
+            request_stop(u);
+        }
+    }
+}
+
+// Reports on the search until it is stopped or its time is up, then ends it and gives the best move.
+// The reply does not wait for the workers to finish their iterations: their results only add to the statistics.
+static void* monitor(void* args) {
+    struct Uci* u = (struct Uci*)args;
+    pthread_mutex_lock(&u->lock);
+    while (!u->stopRequested) {
+        struct timespec wakeAt;
+        clock_gettime(CLOCK_MONOTONIC, &wakeAt);
+        wakeAt.tv_sec += UCI_INFO_MS / 1000;
+        wakeAt.tv_nsec += (UCI_INFO_MS % 1000) * 1000000L;
+        if (wakeAt.tv_nsec >= 1000000000L) {
+            wakeAt.tv_sec++;
+            wakeAt.tv_nsec -= 1000000000L;
+        }
+        uint8_t last = 0;
+        if (u->hasDeadline && (wakeAt.tv_sec > u->deadline.tv_sec
+                    || (wakeAt.tv_sec == u->deadline.tv_sec && wakeAt.tv_nsec >= u->deadline.tv_nsec))) {
+            wakeAt = u->deadline;
+            last = 1;
+        }
+        int r = pthread_cond_timedwait(&u->wake, &u->lock, &wakeAt);
+        if (r == ETIMEDOUT && last)
+            break;
+        if (r == ETIMEDOUT)
+            print_info(u);
+    }
+    u->searching = 0;
+    pthread_mutex_unlock(&u->lock);
+
+    print_info(u);
+    // A ponder search is answered once the GUI says what the opponent played.
+    if (!u->pondering)
+        print_bestmove(u);
+    return NULL;
+}
+
+// Stops the search, if any, once it has replied, and waits for the workers to leave the tree.
+static void end_search(struct Uci* u) {
+    if (!u->monitorRunning)
+        return;
+    request_stop(u);
+    pthread_join(u->monitor, NULL);
+    u->monitorRunning = 0;
+    pool_wait(&u->pool, &u->group);
+}
+
+// Milliseconds to spend on this move, or -1 to search until stopped.
+static long move_time(long ourTime, long ourInc, long movesToGo, long moveTime) {
+    if (moveTime > 0)
+        return moveTime;
+    if (ourTime < 0)
+        return -1;
+    long budget = ourTime / (movesToGo > 0 ? movesToGo : UCI_MOVES_TO_GO) + ourInc * 3 / 4;
+    if (budget > ourTime - UCI_MOVE_OVERHEAD_MS)
+        budget = ourTime - UCI_MOVE_OVERHEAD_MS;
+    return budget > 1 ? budget : 1;
+}
+
+// Searches from the tree's root for ms milliseconds (until stopped if negative) or nodes root visits (if not zero).
+static void start_search(struct Uci* u, long ms, uint64_t nodes) {
+    tree_prune(&u->tree);
+    clock_gettime(CLOCK_MONOTONIC, &u->start);
+    u->hasDeadline = ms >= 0;
+    if (u->hasDeadline) {
+        u->deadline.tv_sec = u->start.tv_sec + ms / 1000;
+        u->deadline.tv_nsec = u->start.tv_nsec + (ms % 1000) * 1000000L;
+        if (u->deadline.tv_nsec >= 1000000000L) {
+            u->deadline.tv_sec++;
+            u->deadline.tv_nsec -= 1000000000L;
+        }
+    }
+    u->nodeLimit = nodes;
+    u->startVisits = u->tree.rootNode->visits;
+    u->stopRequested = 0;
+    if (tree_expand(&u->tree, u->tree.rootNode, &u->tree.root)->n == 0) {
+        // The game is over: nothing to search.
+        if (!u->pondering)
+            print_bestmove(u);
+        return;
+    }
+
+    u->searching = 1;
+    stats_reset(u->workers, u->nthreads, &u->pool);
+    void* tasks[u->nthreads];
+    for (int w = 0; w < u->nthreads; w++)
+        tasks[w] = u;
+    pool_submit(&u->pool, search_task, tasks, u->nthreads, &u->group);
+    if (pthread_create(&u->monitor, NULL, monitor, u) != 0)
+        err(1, "pthread_create(): Cannot start the search monitor");
+    u->monitorRunning = 1;
+}
+
+// ===========================================================================
+// Positions
+// ===========================================================================
+static const char* skip_spaces(const char* c) {
+    while (*c == ' ' || *c == '\t')
+        c++;
+    return c;
+}
+
+// Brings the tree's root to the game's position after its first n moves.
+// If the tree's game leads there, the subtree below it is kept, statistics and all.
+static void sync_tree(struct Uci* u, size_t n) {
+    uint8_t follows = u->treeBaseKey == u->base.key && u->treeLen <= n
+            && (u->treeLen == 0 || memcmp(u->treeMoves, u->moves, u->treeLen * sizeof(uint16_t)) == 0);
+    // What is learnt near the root is saved even once the game has moved past it.
+    if (u->treeFile && !(follows && u->treeLen == n))
+        tree_keep(&u->tree, TREE_SAVE_DEPTH);
+    for (size_t i = u->treeLen; follows && i < n; i++) {
+        struct Children* root = tree_expand(&u->tree, u->tree.rootNode, &u->tree.root);
+        int j = 0;
+        while (j < root->n && root->move[j] != u->moves[i])
+            j++;
+        // A move the root does not have: start again from the game itself.
+        if (j == root->n)
+            follows = 0;
+        else
+            tree_advance(&u->tree, j);
+    }
+    if (!follows) {
+        // Replay the game, keeping the keys before each move for the draw rules.
+        struct State s;
+        memcpy(&s, &u->base, sizeof(struct State));
+        uint64_t* keys = malloc((n + 1) * sizeof(uint64_t));
+        if (keys == NULL)
+            err(1, "malloc(): Cannot allocate game history");
+        for (size_t i = 0; i < n; i++) {
+            struct Move m;
+            struct Undo undo;
+            keys[i] = s.key;
+            unpack_move(&s, u->moves[i], &m);
+            make_move(&s, &m, &undo);
+        }
+        tree_reset(&u->tree, &s);
+        tree_set_history(&u->tree, keys, n);
+        free(keys);
+    }
+    free(u->treeMoves);
+    u->treeMoves = malloc((n + 1) * sizeof(uint16_t));
+    if (u->treeMoves == NULL)
+        err(1, "malloc(): Cannot allocate game moves");
+    memcpy(u->treeMoves, u->moves, n * sizeof(uint16_t));
+    u->treeLen = n;
+    u->treeBaseKey = u->base.key;
+}
+
+// `position startpos|fen <FEN> [moves ...]`. The tree follows when a search starts.
+static void set_position(struct Uci* u, const char* args) {
+    struct State s;
+    const char* c = skip_spaces(args);
+    if (strncmp(c, "startpos", 8) == 0) {
+        memcpy(&s, &initialState, sizeof(struct State));
+        refresh_state(&s);
+        c += 8;
+    } else if (strncmp(c, "fen", 3) == 0) {
+        c = state_from_fen(&s, c + 3);
+    } else {
+        c = NULL;
+    }
+    if (c == NULL) {
+        printf("info string Invalid position\n");
+        fflush(stdout);
+        return;
+    }
+    memcpy(&u->base, &s, sizeof(struct State));
+
+    // Check the moves by playing them.
+    size_t size = 64;
+    free(u->moves);
+    u->nMoves = 0;
+    u->moves = malloc(size * sizeof(uint16_t));
+    if (u->moves == NULL)
+        err(1, "malloc(): Cannot allocate game moves");
+    c = skip_spaces(c);
+    if (strncmp(c, "moves", 5) == 0) {
+        for (c = skip_spaces(c + 5); *c; c = skip_spaces(c)) {
+            size_t len = strcspn(c, " \t");
+            struct Move m;
+            struct Undo undo;
+            if (!find_move(&s, c, len, &m)) {
+                printf("info string Illegal move %.*s\n", (int)len, c);
+                fflush(stdout);
+                break;
+            }
+            if (u->nMoves == size) {
+                size *= 2;
+                u->moves = realloc(u->moves, size * sizeof(uint16_t));
+                if (u->moves == NULL)
+                    err(1, "realloc(): Cannot allocate game moves");
+            }
+            u->moves[u->nMoves++] = pack_move(&m);
+            make_move(&s, &m, &undo);
+            c += len;
+        }
+    }
+}
+
+// ===========================================================================
+// Commands
+// ===========================================================================
+static void go(struct Uci* u, char* args) {
+    end_search(u);
+    u->pondering = 0;
+    long wtime = -1, btime = -1, winc = 0, binc = 0, movesToGo = 0, moveTime = 0;
+    uint64_t nodes = 0;
+    uint8_t infinite = 0, ponder = 0;
+    char* save;
+    for (char* token = strtok_r(args, " \t", &save); token != NULL; token = strtok_r(NULL, " \t", &save)) {
+        if (strcmp(token, "infinite") == 0) {
+            infinite = 1;
+            continue;
+        }
+        if (strcmp(token, "ponder") == 0) {
+            ponder = 1;
+            continue;
+        }
+        char* value = strtok_r(NULL, " \t", &save);
+        if (value == NULL)
+            break;
+        if (strcmp(token, "wtime") == 0)
+            wtime = atol(value);
+        else if (strcmp(token, "btime") == 0)
+            btime = atol(value);
+        else if (strcmp(token, "winc") == 0)
+            winc = atol(value);
+        else if (strcmp(token, "binc") == 0)
+            binc = atol(value);
+        else if (strcmp(token, "movestogo") == 0)
+            movesToGo = atol(value);
+        else if (strcmp(token, "movetime") == 0)
+            moveTime = atol(value);
+        else if (strcmp(token, "nodes") == 0)
+            nodes = strtoull(value, NULL, 10);
+    }
+    uint8_t black = (u->base.ply + u->nMoves) % 2;
+    long ms = infinite ? -1 : move_time(black ? btime : wtime, black ? binc : winc, movesToGo, moveTime);
+
+    if (ponder) {
+        // The last move is only the GUI's guess at the opponent's reply: search all of them
+        // from the position before it, with no limit until ponderhit or stop.
+        // Given no moves, there is no guess to take back, and the position itself is searched.
+        sync_tree(u, u->nMoves > 0 ? u->nMoves - 1 : 0);
+        u->pondering = 1;
+        u->ponderMs = ms;
+        u->ponderNodes = nodes;
+        start_search(u, -1, 0);
+    } else {
+        sync_tree(u, u->nMoves);
+        // A book move is played at once, unless the GUI wants the position analysed.
+        struct Move m;
+        uint16_t weight;
+        uint32_t total;
+        if (!infinite && book_probe(&u->book, &u->tree.root, &m, &weight, &total)) {
+            char str[UCI_MOVE_LEN];
+            move_to_uci(&m, str);
+            printf("info string book move %s weight %u of %u\nbestmove %s\n", str, weight, total, str);
+            fflush(stdout);
+            return;
+        }
+        start_search(u, ms, nodes);
+    }
+}
+
+// The opponent played the move pondered on: move the root to it and search on the clock.
+static void ponderhit(struct Uci* u) {
+    if (!u->pondering)
+        return;
+    end_search(u);
+    sync_tree(u, u->nMoves);
+    u->pondering = 0;
+    start_search(u, u->ponderMs, u->ponderNodes);
+}
+
+static void stop(struct Uci* u) {
+    end_search(u);
+    if (u->pondering) {
+        // A bestmove is owed even for a ponder search; the GUI will give the real position next.
+        sync_tree(u, u->nMoves);
+        u->pondering = 0;
+        print_bestmove(u);
+    }
+}
+
+// Saves the tree's statistics, then seeds from the file as it now is, so the next game starts with this one's.
+static void save_tree(struct Uci* u) {
+    if (u->treeFile && tree_save(&u->tree, u->treeFile, TREE_SAVE_DEPTH))
+        tree_seed(&u->tree, u->treeFile);
+}
+
+static void set_option(struct Uci* u, const char* args) {
+    char name[32], str[8];
+    long value;
+    if (sscanf(args, " name %31s", name) == 1 && strcasecmp(name, "BookFile") == 0) {
+        const char* path = strstr(args, " value ");
+        free(u->bookFile);
+        u->bookFile = NULL;
+        book_close(&u->book);
+        if (path && *(path += 7) && strcmp(path, "<empty>") != 0) {
+            u->bookFile = strdup(path);
+            book_open(&u->book, path);
+        }
+        return;
+    }
+    if (sscanf(args, " name %31s", name) == 1 && strcasecmp(name, "TreeFile") == 0) {
+        // The path is the rest of the line, spaces and all. One not there yet is made by the first save.
+        // Reseeding unmaps the old seeds, which the workers read as they add nodes.
+        end_search(u);
+        u->pondering = 0;
+        const char* path = strstr(args, " value ");
+        free(u->treeFile);
+        u->treeFile = NULL;
+        if (path && *(path += 7) && strcmp(path, "<empty>") != 0) {
+            u->treeFile = strdup(path);
+            if (access(path, F_OK) == 0)
+                tree_seed(&u->tree, path);
+        }
+        return;
+    }
+    if (sscanf(args, " name %31s value %7s", name, str) == 2 && strcasecmp(name, "Stats") == 0) {
+        u->stats = strcasecmp(str, "true") == 0;
+        return;
+    }
+    if (sscanf(args, " name %31s value %ld", name, &value) != 2)
+        return;
+    // The rest change what the workers read as they search.
+    end_search(u);
+    u->pondering = 0;
+    if (strcasecmp(name, "PlayoutPlies") == 0 && value >= 0 && value <= PLAYOUT_MAX_PLIES)
+        u->limits.maxPlies = value;
+    else if (strcasecmp(name, "PlayoutSwing") == 0 && value >= 0 && value <= INT16_MAX)
+        u->limits.swing = value;
+    else if (strcasecmp(name, "Hash") == 0 && value >= 0 && value <= UCI_MAX_HASH_MIB)
+        tree_set_limit(&u->tree, value << 20);
+}
+
+int uci_main(void) {
+    struct Uci u;
+    memset(&u, 0, sizeof(struct Uci));
+    u.nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+    if (u.nthreads < 1)
+        u.nthreads = 1;
+    u.workers = malloc(u.nthreads * sizeof(struct Worker));
+    if (u.workers == NULL)
+        err(1, "malloc(): Cannot allocate workers");
+    for (int t = 0; t < u.nthreads; t++)
+        u.workers[t].rng = playout_seed(time(NULL) + (t * 7));
+    pool_init(&u.pool, u.nthreads);
+    tree_init(&u.tree, &initialState);
+    memcpy(&u.base, &u.tree.root, sizeof(struct State));
+    u.treeBaseKey = u.base.key;
+
+    // Deadlines are on the monotonic clock.
+    pthread_mutex_init(&u.lock, NULL);
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&u.wake, &attr);
+    pthread_condattr_destroy(&attr);
+
+    char* line = NULL;
+    size_t lineSize = 0;
+    ssize_t len;
+    while ((len = getline(&line, &lineSize, stdin)) >= 0) {
+        while (len > 0 && isspace((unsigned char)line[len - 1]))
+            line[--len] = 0;
+        char* args = line + strcspn(line, " \t");
+        size_t cmdLen = args - line;
+
+        if (cmdLen == 3 && strncmp(line, "uci", 3) == 0) {
+            printf("id name Boris\nid author Barys contributors\n");
+            printf("option name Hash type spin default 0 min 0 max %d\n", UCI_MAX_HASH_MIB);
+            printf("option name Ponder type check default false\n");
+            printf("option name TreeFile type string default <empty>\n");
+            printf("option name BookFile type string default <empty>\n");
+            printf("option name Stats type check default false\n");
+            printf("option name PlayoutPlies type spin default 0 min 0 max %d\n", PLAYOUT_MAX_PLIES);
+            printf("option name PlayoutSwing type spin default 0 min 0 max %d\n", INT16_MAX);
+            printf("uciok\n");
+        } else if (cmdLen == 7 && strncmp(line, "isready", 7) == 0) {
+            printf("readyok\n");
+        } else if (cmdLen == 9 && strncmp(line, "setoption", 9) == 0) {
+            set_option(&u, args);
+        } else if (cmdLen == 10 && strncmp(line, "ucinewgame", 10) == 0) {
+            end_search(&u);
+            u.pondering = 0;
+            save_tree(&u);
+            memcpy(&u.base, &initialState, sizeof(struct State));
+            refresh_state(&u.base);
+            u.nMoves = 0;
+            tree_reset(&u.tree, &u.base);
+            u.treeBaseKey = u.base.key;
+            u.treeLen = 0;
+        } else if (cmdLen == 8 && strncmp(line, "position", 8) == 0) {
+            set_position(&u, args);
+        } else if (cmdLen == 2 && strncmp(line, "go", 2) == 0) {
+            go(&u, args);
+        } else if (cmdLen == 9 && strncmp(line, "ponderhit", 9) == 0) {
+            ponderhit(&u);
+        } else if (cmdLen == 4 && strncmp(line, "stop", 4) == 0) {
+            stop(&u);
+        } else if (cmdLen == 4 && strncmp(line, "quit", 4) == 0) {
+            break;
+#ifdef TRACE
+        } else if (cmdLen == 5 && strncmp(line, "trace", 5) == 0 && *args) {
+            // Not UCI: writes the events recorded so far, for chrome://tracing
+            trace_dump(args + 1);
+#endif // TRACE
+        }
+        fflush(stdout);
+    }
+
+    end_search(&u);
+    save_tree(&u);
+    free(line);
+    free(u.treeFile);
+    book_close(&u.book);
+    free(u.bookFile);
+    pool_destroy(&u.pool);
+    tree_destroy(&u.tree);
+    free(u.workers);
+    free(u.moves);
+    free(u.treeMoves);
+    pthread_mutex_destroy(&u.lock);
+    pthread_cond_destroy(&u.wake);
+    return 0;
+}
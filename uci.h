@@ -0,0 +1,24 @@
+#ifndef UCI_H
+#define UCI_H
+
+// ===========================================================================
+// Universal Chess Interface (UCI)
+// The search runs on the pool while the main thread reads commands, and a monitor thread
+// answers for it: info lines as it goes, and bestmove once the budget is spent or it is stopped.
+// https://www.shredderchess.com/download/div/uci.zip
+// ===========================================================================
+// Milliseconds between info lines.
+#define UCI_INFO_MS (1000)
+// Milliseconds kept back from the clock for the reply to reach the GUI.
+#define UCI_MOVE_OVERHEAD_MS (20)
+// Moves the remaining time is shared between when the GUI does not say.
+#define UCI_MOVES_TO_GO (30)
+// Largest memory limit on the tree the Hash option takes, in MiB. 0, the default, is no limit.
+// The tree is only pruned back under the limit between searches: a search that fills it stops growing it and carries
+// on playing out from its leaves until it ends, however long that is.
+#define UCI_MAX_HASH_MIB (1 << 20)
+
+// `boris uci`: speaks UCI on standard input and output until "quit" or the end of input.
+int uci_main(void);
+
+#endif // UCI_H